@@ -0,0 +1,240 @@
+#include "dson.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using namespace dson;
+using namespace std;
+
+namespace {
+
+// Best wall time of a few runs, in seconds
+template <typename F>
+double measure(F&& f, int runs = 5) {
+    double best = 1e30;
+    for (int i = 0; i < runs; ++i) {
+        auto start = chrono::steady_clock::now();
+        f();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        if (elapsed.count() < best) best = elapsed.count();
+    }
+    return best;
+}
+
+void report(const char* name, size_t bytes, double seconds) { printf("%-40s %10.1f MB/s %10.3f ms\n", name, bytes / seconds / 1e6, seconds * 1e3); }
+
+// Array of n same-shaped records, mostly ASCII with some multi-byte UTF-8
+string make_records(size_t n) {
+    string json = "[";
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0) json += ",\n";
+        json += "{\"id\": " + to_string(i) + ", \"name\": \"user_" + to_string(i * 7919 % 100000) + "\", \"score\": " + to_string(i % 1000) + "." + to_string(i % 97) +
+                ", \"active\": " + (i % 3 ? "true" : "false") + ", \"city\": \"" + (i % 5 ? "Hangzhou" : "\xE6\x9D\xAD\xE5\xB7\x9E") +
+                "\", \"tags\": [\"alpha\", \"beta\", \"gamma\"], \"note\": \"the quick brown fox jumps over the lazy dog\"}";
+    }
+    json += "]";
+    return json;
+}
+
+// Array of n long text strings, every fourth one in Chinese
+string make_text(size_t n) {
+    string json = "[";
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0) json += ", ";
+        json += '"';
+        for (int k = 0; k < 8; ++k) json += i % 4 ? "Lorem ipsum dolor sit amet, consectetur adipiscing elit. " : "\xE6\x9D\xAD\xE5\xB7\x9E\xE7\x9A\x84\xE8\xA5\xBF\xE6\xB9\x96\xE5\xBE\x88\xE7\xBE\x8E\xE3\x80\x82";
+        json += '"';
+    }
+    json += "]";
+    return json;
+}
+
+void bench_validate() {
+    string text = make_text(50000);
+    double t = measure([&] {
+        if (validate(text).first != error_type::DSON_OK) printf("validate failed\n");
+    });
+    report("validate (long strings)", text.size(), t);
+
+    string json = make_records(200000);
+    t = measure([&] {
+        if (validate(json).first != error_type::DSON_OK) printf("validate failed\n");
+    });
+    report("validate (records)", json.size(), t);
+    t = measure([&] {
+        dson_parser parser;
+        if (parser.parse(json) != error_type::DSON_OK) printf("parse failed\n");
+    });
+    report("dson_parser::parse", json.size(), t);
+}
+
+void bench_stringify_parallel() {
+    dson_parser parser;
+    parser.parse(make_records(200000));
+    auto root = parser.root();
+    dson_generator sequential;
+    string expect;
+    double base = measure([&] { expect = sequential.stringify_raw(root); }, 3);
+    report("stringify_raw", expect.size(), base);
+    for (unsigned threads : { 1u, 2u, 4u, 8u }) {
+        dson_generator gen;
+        gen.set_parallel(threads);
+        string json;
+        double t = measure([&] { json = gen.stringify_raw(root); }, 3);
+        string name = "stringify_raw parallel x" + to_string(threads);
+        report(name.c_str(), json.size(), t);
+        if (json != expect) printf("output differs with %u threads\n", threads);
+    }
+}
+
+void bench_transcode() {
+    string json = make_records(200000);
+    string pretty = prettify(json).first;
+    double t = measure([&] { minify(pretty); });
+    report("minify (pretty input)", pretty.size(), t);
+    t = measure([&] {
+        string buf = pretty;
+        dson_transcoder::minify_inplace(&buf[0], buf.size());
+    });
+    report("minify_inplace (incl. copy)", pretty.size(), t);
+    t = measure([&] { prettify(json); });
+    report("prettify", json.size(), t);
+    t = measure([&] {
+        dson_transcoder transcoder;
+        string out;
+        for (size_t i = 0; i < pretty.size(); i += 64 * 1024) {
+            transcoder.feed(string_view(pretty).substr(i, 64 * 1024), out);
+            out.clear();
+        }
+        transcoder.finish();
+    });
+    report("minify streaming 64K chunks", pretty.size(), t);
+    t = measure(
+        [&] {
+            dson_parser parser;
+            parser.parse(pretty);
+            dson_generator().stringify_raw(parser.root());
+        },
+        1);
+    report("parse + stringify_raw", pretty.size(), t);
+}
+
+// Array of n rows of ids, prices and ratios
+string make_numbers(size_t n) {
+    string json = "[";
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0) json += ",";
+        json += "[" + to_string(i * 2654435761ULL) + "," + to_string(i % 10000) + "." + to_string(i % 100) + ",-" + to_string(i % 7) + ".25e-" + to_string(i % 9) + "]";
+    }
+    json += "]";
+    return json;
+}
+
+void bench_lazy_number() {
+    string json = make_numbers(500000);
+    for (bool lazy : { false, true }) {
+        dson_parser parser;
+        parser.set_lazy_number(lazy);
+        double t = measure([&] { parser.parse(json); });
+        report(lazy ? "parse, lazy numbers" : "parse, eager numbers", json.size(), t);
+        t = measure([&] {
+            dson_parser p;
+            p.set_lazy_number(lazy);
+            p.parse(json);
+            dson_generator().stringify_raw(p.root());
+        });
+        report(lazy ? "parse + stringify_raw, lazy numbers" : "parse + stringify_raw, eager numbers", json.size(), t);
+    }
+}
+
+void bench_extract_columns() {
+    string json = make_records(200000);
+    double sum = 0;
+    double t = measure([&] {
+        dson_parser parser;
+        parser.parse(json);
+        sum = 0;
+        for (const auto& row : get<vector<shared_ptr<dson_value>>>(parser.root()->option_value().value())) {
+            const auto& obj = get<unordered_map<string, shared_ptr<dson_value>>>(row->option_value().value());
+            sum += get<double>(obj.at("score")->option_value().value());
+        }
+    });
+    report("parse + walk rows (sum score)", json.size(), t);
+    double expect = sum;
+    t = measure([&] {
+        dson_table table;
+        extract_columns(json, "", table);
+        sum = 0;
+        for (const auto& column : table.columns)
+            if (column.name == "score")
+                for (double d : column.doubles) sum += d;
+    });
+    report("extract_columns inferred (sum score)", json.size(), t);
+    if (sum != expect) printf("sums differ\n");
+    t = measure([&] {
+        dson_table table;
+        table.columns.push_back({ "score", dson_column_type::DSON_DOUBLE });
+        extract_columns(json, "", table);
+    });
+    report("extract_columns one column", json.size(), t);
+}
+
+// n string values of len bytes built from pattern
+shared_ptr<dson_value> make_strings(size_t n, size_t len, const string& pattern) {
+    string str;
+    while (str.size() < len) str += pattern;
+    str.resize(len);
+    auto root = make_shared<dson_value>();
+    vector<shared_ptr<dson_value>> arr;
+    for (size_t i = 0; i < n; ++i) {
+        auto v = make_shared<dson_value>();
+        v->set_option_value(str);
+        v->set_type(dson_type::DSON_STRING);
+        arr.push_back(v);
+    }
+    root->set_option_value(move(arr));
+    root->set_type(dson_type::DSON_ARRAY);
+    return root;
+}
+
+void bench_escape() {
+    struct {
+        const char* name;
+        string pattern;
+        bool escape_unicode;
+    } cases[] = {
+        { "stringify ascii-clean strings", "the quick brown fox jumps over the lazy dog ", false },
+        { "stringify escape-dense strings", "a\"b\\c\n\t\x01", false },
+        { "stringify utf-8 strings", "\xE6\x9D\xAD\xE5\xB7\x9E west lake ", false },
+        { "stringify utf-8 strings, escape_unicode", "\xE6\x9D\xAD\xE5\xB7\x9E west lake ", true },
+    };
+    for (const auto& c : cases) {
+        auto root = make_strings(20000, 1000, c.pattern);
+        dson_generator gen;
+        gen.set_escape_unicode(c.escape_unicode);
+        size_t bytes = 0;
+        double t = measure([&] { bytes = gen.stringify_raw(root).size(); });
+        report(c.name, bytes, t);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    struct {
+        const char* name;
+        void (*run)();
+    } benches[] = {
+        { "validate", bench_validate },
+        { "stringify_parallel", bench_stringify_parallel },
+        { "transcode", bench_transcode },
+        { "lazy_number", bench_lazy_number },
+        { "extract_columns", bench_extract_columns },
+        { "escape", bench_escape },
+    };
+    for (auto& b : benches)
+        if (argc < 2 || strcmp(argv[1], b.name) == 0) b.run();
+    return 0;
+}
@@ -1,10 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -26,11 +31,63 @@ enum class error_type {
     DSON_MISS_KEY,
     DSON_MISS_COLON,
     DSON_MISS_COMMA_OR_CURLY_BRACKET,
+    DSON_INVALID_UTF8,
+    DSON_INVALID_POINTER,
+    DSON_POINTER_NOT_FOUND,
+    DSON_INVALID_PATCH,
+    DSON_PATCH_TEST_FAILED,
+    DSON_SCHEMA_MISMATCH,
+};
+
+// A number kept as its source text, produced by dson_parser in lazy number mode. Nothing is
+// converted until asked for; results are cached and the cache is safe to fill from several threads.
+// The text is not copied, so the parsed input must outlive every tree that holds lazy numbers,
+// unless own_text() was called.
+class dson_number {
+public:
+    // raw must be a grammatically valid JSON number
+    explicit dson_number(std::string_view raw);
+    dson_number(const dson_number& other);
+    dson_number& operator=(const dson_number& other);
+    ~dson_number() { delete decimal_.load(std::memory_order_relaxed); }
+
+    std::string_view raw() const { return raw_; }
+
+    // Copies the text into storage shared by this number and its later copies
+    void own_text();
+
+    bool is_negative() const { return flags_ & NEGATIVE; }
+    bool has_fraction() const { return flags_ & FRACTION; }
+    bool has_exponent() const { return flags_ & EXPONENT; }
+    // No fraction and no exponent in the text
+    bool is_integer() const { return !(flags_ & (FRACTION | EXPONENT)); }
+
+    double as_double() const;
+    // The exact value if it is a whole number that fits, e.g. "12", "1.5e1" or "-3.000"
+    std::optional<int64_t> as_int64() const;
+    // Plain decimal notation of the exact value with the digits as written, e.g. "-1.50e2" -> "-150"
+    // and "25E-3" -> "0.025"; the raw text if the exponent is beyond +-1000. Cached like the others,
+    // the reference stays valid as long as the number.
+    const std::string& as_decimal_string() const;
+
+private:
+    std::string decimal_string() const;
+
+    enum : uint8_t { NEGATIVE = 1, FRACTION = 2, EXPONENT = 4 };
+    enum : uint8_t { HAS_DOUBLE = 1, HAS_INT64 = 2, NOT_INT64 = 4 };
+
+    std::string_view raw_;
+    std::shared_ptr<const std::string> text_;
+    uint8_t flags_;
+    mutable std::atomic<uint8_t> cached_{ 0 };
+    mutable std::atomic<double> double_{ 0 };
+    mutable std::atomic<int64_t> int64_{ 0 };
+    mutable std::atomic<const std::string*> decimal_{ nullptr };
 };
 
 class dson_value {
 public:
-    using value_type = std::variant<double, std::string, std::vector<std::shared_ptr<dson_value>>, std::unordered_map<std::string, std::shared_ptr<dson_value>>>;
+    using value_type = std::variant<double, std::string, std::vector<std::shared_ptr<dson_value>>, std::unordered_map<std::string, std::shared_ptr<dson_value>>, dson_number>;
 
 public:
     dson_value() : type_(dson_type::DSON_NULL) {}
@@ -40,29 +97,204 @@ public:
     void set_type(dson_type type) { type_ = type; }
 
     std::optional<value_type>& option_value() { return val_; }
+    const std::optional<value_type>& option_value() const { return val_; }
     // Must use with set_type
-    void set_option_value(const value_type& v) { val_.emplace(std::move(v)); }
+    void set_option_value(value_type v) { val_.emplace(std::move(v)); }
+
+    // Value of a DSON_NUMBER node, whether it holds a double or a dson_number
+    double as_double() const;
+
+    // Deep hash; values that compare equal hash equal
+    size_t hash() const;
+
+    // Deep equality; numbers compare by their exact value, lazy or not, so 1.0 == 1 and -0 == 0, but
+    // a lazy 0.1 differs from the double 0.1 and lazy numbers beyond 2^53 keep every digit
+    friend bool operator==(const dson_value& lhs, const dson_value& rhs);
+    friend bool operator!=(const dson_value& lhs, const dson_value& rhs) { return !(lhs == rhs); }
 
 private:
     dson_type type_;
     std::optional<value_type> val_;
 };
 
+// Immutable snapshot of a tree. Copying a document only copies a pointer, and snapshots can be read
+// from any number of threads without locking. Edits return a new document that copies the nodes on
+// the path from the root to the change and shares every other subtree with this one. Copying a node
+// copies its whole array or member map, one pointer (and, for objects, one map entry) per child, so
+// an edit costs the sum of the widths of the containers on the path, not just its depth; very wide
+// containers that are edited often are better split into nested ones.
+// Paths are JSON Pointers (RFC 6901), e.g. "/servers/0/port"; "" is the root.
+class dson_document {
+public:
+    dson_document() : root_(std::make_shared<dson_value>()) {}
+    // The tree must not be modified through other references afterwards
+    explicit dson_document(std::shared_ptr<const dson_value> root) : root_(std::move(root)) {}
+
+    const std::shared_ptr<const dson_value>& root() const { return root_; }
+
+    // nullptr if the path does not resolve
+    std::shared_ptr<const dson_value> find(const std::string_view& path) const;
+
+    // Replaces an array element or adds/replaces an object member
+    std::pair<dson_document, error_type> set(const std::string_view& path, std::shared_ptr<const dson_value> value) const;
+    // Inserts before an array element ("-" appends) or adds/replaces an object member
+    std::pair<dson_document, error_type> insert(const std::string_view& path, std::shared_ptr<const dson_value> value) const;
+    // Removes an array element or an object member
+    std::pair<dson_document, error_type> erase(const std::string_view& path) const;
+
+private:
+    std::shared_ptr<const dson_value> root_;
+};
+
 class dson_parser {
 public:
     dson_parser() : value_(new dson_value) {}
 
+    // Lazy mode stores numbers as dson_number views into the input instead of converting them, so
+    // the input must outlive the tree. Numbers keep their exact text through stringify_raw.
+    void set_lazy_number(bool lazy) { lazy_number_ = lazy; }
+
     error_type parse(const std::string_view& json);
 
     std::shared_ptr<dson_value> root() { return value_; }
 
 private:
     std::shared_ptr<dson_value> value_;
+    bool lazy_number_ = false;
 };
 
+class dson_thread_pool;
+
 class dson_generator {
 public:
+    // Opt-in parallel mode: containers with at least grain elements are split into chunks that are
+    // serialized on up to threads threads (0 = hardware concurrency). The output is byte-identical
+    // to the sequential one. The worker threads are started here and kept for later calls, so a
+    // configured generator can be shared; copies share the workers, and calls through them take turns.
+    void set_parallel(unsigned threads, size_t grain = 4096);
+
+    // Writes non-ASCII characters as \uXXXX escapes (surrogate pairs above U+FFFF) for ASCII-only
+    // consumers; bytes that are not valid UTF-8 become \uFFFD
+    void set_escape_unicode(bool escape) { escape_unicode_ = escape; }
+
     std::string stringify_raw(const std::shared_ptr<dson_value>& root);
+    // Hands the output to sink as ordered buffers (e.g. for writev) instead of concatenating them
+    void stringify_raw(const std::shared_ptr<dson_value>& root, const std::function<void(const std::vector<std::string_view>&)>& sink);
+
+private:
+    size_t grain_ = 4096;
+    bool escape_unicode_ = false;
+    std::shared_ptr<dson_thread_pool> pool_;  // nullptr when sequential
+};
+
+enum class dson_column_type { DSON_INT64, DSON_DOUBLE, DSON_STRING, DSON_BOOL };
+
+// One member of every row, stored contiguously. Row i holds a value if bit i of validity is set;
+// null rows hold 0 or an empty string.
+struct dson_column {
+    std::string name;
+    dson_column_type type = dson_column_type::DSON_DOUBLE;
+    std::vector<uint8_t> validity;  // bit i % 8 of byte i / 8
+    std::vector<int64_t> int64s;    // DSON_INT64, and DSON_BOOL as 0 or 1
+    std::vector<double> doubles;    // DSON_DOUBLE
+    std::vector<size_t> offsets;    // DSON_STRING: row i is bytes[offsets[i], offsets[i + 1])
+    std::string bytes;              // DSON_STRING, unescaped UTF-8
+
+    bool is_valid(size_t row) const { return (validity[row / 8] >> (row % 8)) & 1; }
+    std::string_view string_at(size_t row) const { return std::string_view(bytes).substr(offsets[row], offsets[row + 1] - offsets[row]); }
 };
 
+struct dson_table {
+    size_t rows = 0;
+    std::vector<dson_column> columns;
+};
+
+// Re-formats JSON text without building a tree: only the whitespace between tokens changes, number
+// and string tokens are copied byte for byte. The grammar is checked with the parser's error codes:
+// literals, numbers, string characters and escapes, bracket nesting, separators and the
+// key/colon/value order of object members. Like the parser it does not check UTF-8 (see validate).
+// Input may hold several top-level values, which are written on separate lines, so
+// newline-delimited logs keep their shape.
+class dson_transcoder {
+public:
+    // indent < 0 minifies, otherwise pretty prints with indent spaces per level
+    explicit dson_transcoder(int indent = -1) : indent_(indent) {}
+
+    // Appends the transcoded next chunk to out; chunks may split tokens anywhere
+    error_type feed(const std::string_view& chunk, std::string& out);
+    // Ends the input; the transcoder can be fed again afterwards
+    error_type finish();
+
+    // Minifies json[0, size) in place, returning the new size
+    static std::pair<size_t, error_type> minify_inplace(char* json, size_t size);
+
+private:
+    template <typename Out>
+    void run(const char* p, const char* end, Out& out);
+    template <typename Out>
+    bool begin_value(Out& out, bool key = false);
+    template <typename Out>
+    void close(char ch, Out& out);
+    template <typename Out>
+    void newline(Out& out);
+    void end_value() {
+        need_separator_ = true;
+        skipped_whitespace_ = false;
+    }
+    void escape(char ch);
+    void end_scalar(const std::string_view& token);
+
+private:
+    // how far an escape sequence, which a chunk may end in the middle of, has got
+    enum : uint8_t { ESCAPE_NONE, ESCAPE_START, ESCAPE_HEX, ESCAPE_LOW_BACKSLASH, ESCAPE_LOW_U };
+
+    int indent_;
+    error_type error_ = error_type::DSON_OK;
+    std::string stack_;  // open brackets
+    bool in_string_ = false;
+    uint8_t escape_ = ESCAPE_NONE;
+    uint8_t hex_left_ = 0;
+    bool low_surrogate_ = false;
+    unsigned int hex_ = 0;
+    bool in_scalar_ = false;
+    std::string scalar_;  // start of a literal or number that the previous chunk cut off
+    bool pending_open_ = false;  // container opened, newline deferred until it proves non-empty
+    bool need_separator_ = false;
+    // where the innermost object is; a parent always resumes after its value once a child closes
+    bool expect_key_ = false;
+    bool in_key_ = false;
+    bool expect_colon_ = false;
+    bool skipped_whitespace_ = false;
+    bool seen_value_ = false;
+};
+
+std::pair<std::string, error_type> minify(const std::string_view& json);
+std::pair<std::string, error_type> prettify(const std::string_view& json, int indent = 4);
+
+// Applies a JSON Patch (RFC 6902) to root in place. Either every operation is applied or, on error,
+// root is left as it was. Values taken from patch are copied, so the two trees never share nodes,
+// and lazy numbers among them get their own text, so patch and its input may be freed afterwards.
+error_type apply_patch(const std::shared_ptr<dson_value>& root, const std::shared_ptr<const dson_value>& patch);
+
+// Applies a JSON Merge Patch (RFC 7396) to root in place, copying values from patch as apply_patch does
+void apply_merge_patch(const std::shared_ptr<dson_value>& root, const std::shared_ptr<const dson_value>& patch);
+
+// Minimal JSON Patch that turns a into b. Each call hashes both trees once and groups equal
+// subtrees into classes, so identical subtrees are skipped in O(1) by pointer or by class; the
+// "value" members of the result share nodes with b.
+std::shared_ptr<dson_value> diff(const std::shared_ptr<const dson_value>& a, const std::shared_ptr<const dson_value>& b);
+
+// Checks that json is a single JSON value in valid UTF-8 without building a tree.
+// Returns the error and the byte offset where it was detected (json.size() on success).
+std::pair<error_type, size_t> validate(const std::string_view& json);
+
+// Reads the array of objects at path (a JSON Pointer) straight from the text into the columns of
+// table, in one pass and without building a tree. Columns already in table are the schema: only
+// those members are read and a value of another type is DSON_SCHEMA_MISMATCH. Otherwise the schema
+// is inferred: a member gets a column at its first non-null scalar value, earlier rows are null,
+// and an INT64 column widens to DOUBLE at the first number that is not an int64. Nested values
+// never start a column. Missing members are null, and of duplicate keys the last one wins.
+// The whole text is validated; returns the error and the byte offset where it was detected.
+std::pair<error_type, size_t> extract_columns(const std::string_view& json, const std::string_view& path, dson_table& table);
+
 }  // namespace dson
@@ -0,0 +1,358 @@
+#include "internal.hpp"
+
+#include <charconv>
+#include <cstring>
+
+using namespace std;
+
+namespace dson {
+
+namespace {
+
+// Appends the contents of a validated string token without its quotes
+void unescape(const char* p, const char* end, string& out) {
+    while (p != end) {
+        const char* q = static_cast<const char*>(memchr(p, '\\', end - p));
+        if (!q) q = end;
+        out.append(p, q - p);
+        if (q == end) return;
+        p = q + 2;
+        switch (q[1]) {
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                unsigned int u = 0, low = 0;
+                parse_hex4(p, end, u);
+                p += 4;
+                if (u >= 0xD800 && u <= 0xDBFF) {
+                    parse_hex4(p + 2, end, low);
+                    u = 0x10000 + ((u - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+                encode_utf8(u, out);
+            } break;
+            default: out.push_back(q[1]);
+        }
+    }
+}
+
+inline void set_bit(vector<uint8_t>& bits, size_t i, bool on) {
+    if (on)
+        bits[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+    else
+        bits[i / 8] &= static_cast<uint8_t>(~(1u << (i % 8)));
+}
+
+// Walks the text with a validator, descending along the pointer and filling columns at its target
+class dson_columnar_context {
+public:
+    dson_columnar_context(const string_view& json, dson_table& table) : ctx_(json), table_(table), infer_(table.columns.empty()) {}
+
+    error_type run(const vector<string>& tokens);
+
+    size_t offset() const { return ctx_.offset(); }
+
+private:
+    error_type seek(const vector<string>& tokens, size_t depth, bool& found);
+    error_type parse_key(string_view& key);
+    error_type separator(char close);
+    error_type extract_rows();
+    error_type extract_row();
+    error_type store(dson_column* column, const string_view& key, size_t position, const char* begin);
+    dson_column* find_column(const string_view& key, size_t position);
+    dson_column& add_column(const string_view& key, size_t position, dson_column_type type);
+    void reset();
+    void begin_row();
+    void end_row();
+    void widen(dson_column& column);
+
+    char front() { return ctx_.view().empty() ? '\0' : ctx_.view().front(); }
+    void consume() { ctx_.view().remove_prefix(1); }
+    // Moves back to p, so that the offset points at the offending value
+    void rewind(const char* p) { ctx_.view() = string_view(p, ctx_.view().data() + ctx_.view().size() - p); }
+    // A well-formed value of the wrong shape is a mismatch, anything else the grammar error
+    error_type mismatch() {
+        const char* begin = ctx_.view().data();
+        error_type err = ctx_.validate();
+        if (err != error_type::DSON_OK) return err;
+        rewind(begin);
+        return error_type::DSON_SCHEMA_MISMATCH;
+    }
+
+private:
+    dson_validate_context ctx_;
+    dson_table& table_;
+    bool infer_;
+    unordered_map<string, size_t> index_;
+    vector<size_t> hints_;  // column of the member at each position in the previous row
+    string key_;            // unescaped key
+};
+
+error_type dson_columnar_context::run(const vector<string>& tokens) {
+    ctx_.skip_whitespace();
+    bool found = false;
+    error_type err = seek(tokens, 0, found);
+    if (err != error_type::DSON_OK) return err;
+    ctx_.skip_whitespace();
+    if (!ctx_.is_completed()) return error_type::DSON_ROOT_NOT_SINGULAR;
+    return found ? error_type::DSON_OK : error_type::DSON_POINTER_NOT_FOUND;
+}
+
+error_type dson_columnar_context::parse_key(string_view& key) {
+    if (front() != '"') return error_type::DSON_MISS_KEY;
+    const char* begin = ctx_.view().data();
+    error_type err = ctx_.validate_string();
+    if (err != error_type::DSON_OK) return err;
+    const char* end = ctx_.view().data() - 1;
+    if (memchr(begin + 1, '\\', end - begin - 1)) {
+        key_.clear();
+        unescape(begin + 1, end, key_);
+        key = key_;
+    }
+    else
+        key = string_view(begin + 1, end - begin - 1);
+    ctx_.skip_whitespace();
+    if (front() != ':') return error_type::DSON_MISS_COLON;
+    consume();
+    ctx_.skip_whitespace();
+    return error_type::DSON_OK;
+}
+
+// After a member or element: DSON_OK with more to come, DSON_EXPECT_VALUE once close was consumed
+error_type dson_columnar_context::separator(char close) {
+    ctx_.skip_whitespace();
+    if (front() == ',') {
+        consume();
+        ctx_.skip_whitespace();
+        return error_type::DSON_OK;
+    }
+    if (front() == close) {
+        consume();
+        return error_type::DSON_EXPECT_VALUE;
+    }
+    return close == ']' ? error_type::DSON_MISS_COMMA_OR_SQUARE_BRACKET : error_type::DSON_MISS_COMMA_OR_CURLY_BRACKET;
+}
+
+error_type dson_columnar_context::seek(const vector<string>& tokens, size_t depth, bool& found) {
+    if (depth == tokens.size()) {
+        found = true;
+        return extract_rows();
+    }
+    char open = front();
+    if (open != '[' && open != '{') return ctx_.validate();
+    char close = open == '[' ? ']' : '}';
+    size_t index = 0;
+    bool indexed = open == '[' && parse_index(tokens[depth], index);
+    consume();
+    ctx_.skip_whitespace();
+    if (front() == close) {
+        consume();
+        return error_type::DSON_OK;
+    }
+    for (size_t i = 0;; ++i) {
+        bool match = indexed && i == index;
+        if (open == '{') {
+            string_view key;
+            error_type err = parse_key(key);
+            if (err != error_type::DSON_OK) return err;
+            match = key == tokens[depth];
+        }
+        error_type err = match ? seek(tokens, depth + 1, found) : ctx_.validate();
+        if (err != error_type::DSON_OK) return err;
+        err = separator(close);
+        if (err == error_type::DSON_EXPECT_VALUE) return error_type::DSON_OK;
+        if (err != error_type::DSON_OK) return err;
+    }
+}
+
+void dson_columnar_context::reset() {
+    // a duplicate key on the path extracts again, so the last one wins
+    table_.rows = 0;
+    hints_.clear();
+    index_.clear();
+    if (infer_) table_.columns.clear();
+    for (size_t i = 0; i < table_.columns.size(); ++i) {
+        dson_column& column = table_.columns[i];
+        column.validity.clear();
+        column.int64s.clear();
+        column.doubles.clear();
+        column.offsets.assign(column.type == dson_column_type::DSON_STRING ? 1 : 0, 0);
+        column.bytes.clear();
+        index_.emplace(column.name, i);
+    }
+}
+
+error_type dson_columnar_context::extract_rows() {
+    reset();
+    if (front() != '[') return mismatch();
+    consume();
+    ctx_.skip_whitespace();
+    if (front() == ']') {
+        consume();
+        return error_type::DSON_OK;
+    }
+    while (true) {
+        if (front() != '{') return mismatch();
+        error_type err = extract_row();
+        if (err != error_type::DSON_OK) return err;
+        err = separator(']');
+        if (err == error_type::DSON_EXPECT_VALUE) return error_type::DSON_OK;
+        if (err != error_type::DSON_OK) return err;
+    }
+}
+
+void dson_columnar_context::begin_row() {
+    for (dson_column& column : table_.columns) {
+        if (table_.rows % 8 == 0) column.validity.push_back(0);
+        switch (column.type) {
+            case dson_column_type::DSON_DOUBLE: column.doubles.push_back(0); break;
+            case dson_column_type::DSON_STRING: break;
+            default: column.int64s.push_back(0);
+        }
+    }
+}
+
+void dson_columnar_context::end_row() {
+    for (dson_column& column : table_.columns)
+        if (column.type == dson_column_type::DSON_STRING) column.offsets.push_back(column.bytes.size());
+    ++table_.rows;
+}
+
+error_type dson_columnar_context::extract_row() {
+    begin_row();
+    consume();
+    ctx_.skip_whitespace();
+    if (front() == '}') {
+        consume();
+        end_row();
+        return error_type::DSON_OK;
+    }
+    for (size_t position = 0;; ++position) {
+        string_view key;
+        error_type err = parse_key(key);
+        if (err != error_type::DSON_OK) return err;
+        const char* begin = ctx_.view().data();
+        err = ctx_.validate();
+        if (err != error_type::DSON_OK) return err;
+        err = store(find_column(key, position), key, position, begin);
+        if (err != error_type::DSON_OK) return err;
+        err = separator('}');
+        if (err == error_type::DSON_EXPECT_VALUE) break;
+        if (err != error_type::DSON_OK) return err;
+    }
+    end_row();
+    return error_type::DSON_OK;
+}
+
+dson_column* dson_columnar_context::find_column(const string_view& key, size_t position) {
+    // rows of the same shape hit the hint and skip the hash lookup
+    if (position < hints_.size() && hints_[position] < table_.columns.size() && table_.columns[hints_[position]].name == key) return &table_.columns[hints_[position]];
+    auto iter = index_.find(string(key));
+    if (iter == index_.end()) return nullptr;
+    if (position >= hints_.size()) hints_.resize(position + 1, SIZE_MAX);
+    hints_[position] = iter->second;
+    return &table_.columns[iter->second];
+}
+
+dson_column& dson_columnar_context::add_column(const string_view& key, size_t position, dson_column_type type) {
+    // earlier rows, and the current one until the value is stored, are null
+    size_t rows = table_.rows + 1;
+    dson_column& column = table_.columns.emplace_back();
+    column.name = string(key);
+    column.type = type;
+    column.validity.assign((rows + 7) / 8, 0);
+    if (type == dson_column_type::DSON_DOUBLE)
+        column.doubles.assign(rows, 0);
+    else if (type == dson_column_type::DSON_STRING)
+        column.offsets.assign(rows, 0);
+    else
+        column.int64s.assign(rows, 0);
+    index_.emplace(column.name, table_.columns.size() - 1);
+    if (position >= hints_.size()) hints_.resize(position + 1, SIZE_MAX);
+    hints_[position] = table_.columns.size() - 1;
+    return column;
+}
+
+void dson_columnar_context::widen(dson_column& column) {
+    column.type = dson_column_type::DSON_DOUBLE;
+    column.doubles.assign(column.int64s.begin(), column.int64s.end());
+    column.int64s.clear();
+    column.int64s.shrink_to_fit();
+}
+
+error_type dson_columnar_context::store(dson_column* column, const string_view& key, size_t position, const char* begin) {
+    string_view token(begin, ctx_.view().data() - begin);
+    char ch = token.front();
+    bool number = ch == '-' || is_digit(ch);
+    bool integer = number && token.find_first_of(".eE") == string_view::npos;
+    int64_t i64 = 0;
+    if (integer) {
+        auto [ptr, ec] = from_chars(token.data(), token.data() + token.size(), i64);
+        integer = ec == errc() && ptr == token.data() + token.size();
+    }
+    if (!column) {
+        if (!infer_ || ch == 'n' || ch == '[' || ch == '{') return error_type::DSON_OK;
+        dson_column_type type = integer ? dson_column_type::DSON_INT64 : (number ? dson_column_type::DSON_DOUBLE : (ch == '"' ? dson_column_type::DSON_STRING : dson_column_type::DSON_BOOL));
+        column = &add_column(key, position, type);
+    }
+    size_t row = table_.rows;
+    if (ch == 'n') {
+        set_bit(column->validity, row, false);
+        if (column->type == dson_column_type::DSON_STRING) column->bytes.resize(column->offsets.back());
+        return error_type::DSON_OK;
+    }
+    bool ok = true;
+    switch (column->type) {
+        case dson_column_type::DSON_INT64:
+            if (integer)
+                column->int64s.back() = i64;
+            else if (number && infer_) {
+                widen(*column);
+                column->doubles.back() = parse_double(token);
+            }
+            else
+                ok = false;
+            break;
+        case dson_column_type::DSON_DOUBLE:
+            if (number)
+                column->doubles.back() = integer ? static_cast<double>(i64) : parse_double(token);
+            else
+                ok = false;
+            break;
+        case dson_column_type::DSON_STRING:
+            if (ch == '"') {
+                column->bytes.resize(column->offsets.back());
+                unescape(token.data() + 1, token.data() + token.size() - 1, column->bytes);
+            }
+            else
+                ok = false;
+            break;
+        case dson_column_type::DSON_BOOL:
+            if (ch == 't' || ch == 'f')
+                column->int64s.back() = ch == 't';
+            else
+                ok = false;
+            break;
+    }
+    if (!ok) {
+        rewind(begin);
+        return error_type::DSON_SCHEMA_MISMATCH;
+    }
+    set_bit(column->validity, row, true);
+    return error_type::DSON_OK;
+}
+
+}  // namespace
+
+}  // namespace dson
+
+pair<dson::error_type, size_t> dson::extract_columns(const string_view& json, const string_view& path, dson_table& table) {
+    vector<string> tokens;
+    if (!parse_pointer(path, tokens)) return make_pair(error_type::DSON_INVALID_POINTER, 0);
+    dson_columnar_context ctx(json, table);
+    error_type err = ctx.run(tokens);
+    return make_pair(err, ctx.offset());
+}
@@ -0,0 +1,187 @@
+#include "internal.hpp"
+
+#include <cassert>
+
+using namespace std;
+
+namespace dson {
+
+bool parse_pointer(const string_view& path, vector<string>& tokens) {
+    tokens.clear();
+    if (path.empty()) return true;
+    if (path.front() != '/') return false;
+    string token;
+    for (size_t i = 1; i <= path.size(); ++i) {
+        if (i == path.size() || path[i] == '/') {
+            tokens.push_back(move(token));
+            token.clear();
+        }
+        else if (path[i] == '~') {
+            if (++i == path.size()) return false;
+            if (path[i] == '0')
+                token.push_back('~');
+            else if (path[i] == '1')
+                token.push_back('/');
+            else
+                return false;
+        }
+        else
+            token.push_back(path[i]);
+    }
+    return true;
+}
+
+bool parse_index(const string_view& token, size_t& index) {
+    if (token.empty() || (token.size() > 1 && token.front() == '0') || token.size() > 18) return false;
+    index = 0;
+    for (char ch : token) {
+        if (!is_digit(ch)) return false;
+        index = index * 10 + (ch - '0');
+    }
+    return true;
+}
+
+namespace {
+
+enum class edit_op { SET, INSERT, ERASE };
+
+class dson_edit_context {
+public:
+    dson_edit_context(const vector<string>& tokens, edit_op op, const shared_ptr<const dson_value>& value) : tokens_(tokens), op_(op), value_(const_pointer_cast<dson_value>(value)) {}
+
+    // Builds the copy of node with the edit applied below it
+    error_type edit(const dson_value& node, size_t depth, shared_ptr<dson_value>& out);
+
+private:
+    error_type edit_array(const array_type& arr, size_t depth, array_type& out);
+    error_type edit_object(const object_type& obj, size_t depth, object_type& out);
+
+private:
+    const vector<string>& tokens_;
+    edit_op op_;
+    shared_ptr<dson_value> value_;
+};
+
+error_type dson_edit_context::edit_array(const array_type& arr, size_t depth, array_type& out) {
+    const string& token = tokens_[depth];
+    bool last = depth + 1 == tokens_.size();
+    size_t index;
+    if (token == "-")
+        index = arr.size();
+    else if (!parse_index(token, index))
+        return error_type::DSON_INVALID_POINTER;
+    if (index > arr.size() || (index == arr.size() && !(last && op_ == edit_op::INSERT))) return error_type::DSON_POINTER_NOT_FOUND;
+    shared_ptr<dson_value> child;
+    if (!last) {
+        error_type err = edit(*arr[index], depth + 1, child);
+        if (err != error_type::DSON_OK) return err;
+    }
+    out.reserve(arr.size() + 1);
+    out.assign(arr.begin(), arr.begin() + index);
+    if (!last)
+        out.push_back(move(child));
+    else if (op_ != edit_op::ERASE)
+        out.push_back(value_);
+    size_t rest = (last && op_ == edit_op::INSERT) ? index : index + 1;
+    out.insert(out.end(), arr.begin() + rest, arr.end());
+    return error_type::DSON_OK;
+}
+
+error_type dson_edit_context::edit_object(const object_type& obj, size_t depth, object_type& out) {
+    const string& key = tokens_[depth];
+    auto iter = obj.find(key);
+    if (depth + 1 < tokens_.size()) {
+        if (iter == obj.end()) return error_type::DSON_POINTER_NOT_FOUND;
+        shared_ptr<dson_value> child;
+        error_type err = edit(*iter->second, depth + 1, child);
+        if (err != error_type::DSON_OK) return err;
+        out = obj;
+        out[key] = move(child);
+    }
+    else if (op_ == edit_op::ERASE) {
+        if (iter == obj.end()) return error_type::DSON_POINTER_NOT_FOUND;
+        out = obj;
+        out.erase(key);
+    }
+    else {
+        out = obj;
+        out[key] = value_;
+    }
+    return error_type::DSON_OK;
+}
+
+error_type dson_edit_context::edit(const dson_value& node, size_t depth, shared_ptr<dson_value>& out) {
+    error_type err = error_type::DSON_POINTER_NOT_FOUND;
+    if (node.type() == dson_type::DSON_ARRAY) {
+        array_type arr;
+        err = edit_array(get<array_type>(node.option_value().value()), depth, arr);
+        if (err == error_type::DSON_OK) {
+            out = make_shared<dson_value>();
+            out->set_option_value(move(arr));
+            out->set_type(dson_type::DSON_ARRAY);
+        }
+    }
+    else if (node.type() == dson_type::DSON_OBJECT) {
+        object_type obj;
+        err = edit_object(get<object_type>(node.option_value().value()), depth, obj);
+        if (err == error_type::DSON_OK) {
+            out = make_shared<dson_value>();
+            out->set_option_value(move(obj));
+            out->set_type(dson_type::DSON_OBJECT);
+        }
+    }
+    return err;
+}
+
+pair<dson_document, error_type> apply_edit(const dson_document& doc, const string_view& path, edit_op op, const shared_ptr<const dson_value>& value) {
+    vector<string> tokens;
+    if (!parse_pointer(path, tokens)) return make_pair(doc, error_type::DSON_INVALID_POINTER);
+    if (tokens.empty()) {
+        if (op == edit_op::ERASE) return make_pair(doc, error_type::DSON_INVALID_POINTER);
+        return make_pair(dson_document(value), error_type::DSON_OK);
+    }
+    dson_edit_context ctx(tokens, op, value);
+    shared_ptr<dson_value> root;
+    error_type err = ctx.edit(*doc.root(), 0, root);
+    if (err != error_type::DSON_OK) return make_pair(doc, err);
+    return make_pair(dson_document(move(root)), error_type::DSON_OK);
+}
+
+}  // namespace
+
+}  // namespace dson
+
+shared_ptr<const dson::dson_value> dson::dson_document::find(const string_view& path) const {
+    vector<string> tokens;
+    if (!parse_pointer(path, tokens)) return nullptr;
+    shared_ptr<const dson_value> node = root_;
+    for (const string& token : tokens) {
+        if (node->type() == dson_type::DSON_ARRAY) {
+            const auto& arr = get<array_type>(node->option_value().value());
+            size_t index;
+            if (!parse_index(token, index) || index >= arr.size()) return nullptr;
+            node = arr[index];
+        }
+        else if (node->type() == dson_type::DSON_OBJECT) {
+            const auto& obj = get<object_type>(node->option_value().value());
+            auto iter = obj.find(token);
+            if (iter == obj.end()) return nullptr;
+            node = iter->second;
+        }
+        else
+            return nullptr;
+    }
+    return node;
+}
+
+pair<dson::dson_document, dson::error_type> dson::dson_document::set(const string_view& path, shared_ptr<const dson_value> value) const {
+    assert(value);
+    return apply_edit(*this, path, edit_op::SET, value);
+}
+
+pair<dson::dson_document, dson::error_type> dson::dson_document::insert(const string_view& path, shared_ptr<const dson_value> value) const {
+    assert(value);
+    return apply_edit(*this, path, edit_op::INSERT, value);
+}
+
+pair<dson::dson_document, dson::error_type> dson::dson_document::erase(const string_view& path) const { return apply_edit(*this, path, edit_op::ERASE, nullptr); }
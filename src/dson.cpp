@@ -4,13 +4,14 @@
 #endif
 
 #include "dson.hpp"
+#include "internal.hpp"
 
 #include <cassert>
 #include <cctype>
 #include <cerrno>
 #include <cmath>
+#include <cstdio>
 #include <cstdlib>
-#include <sstream>
 
 #if 1
 #include <iostream>
@@ -20,22 +21,9 @@ using namespace std;
 
 namespace dson {
 
-class dson_generate_context {
-public:
-    string stringify(const shared_ptr<dson_value>& root);
-
-private:
-    void stringify_string(const string& str);
-
-private:
-    stringstream sstream_;
-
-    static constexpr char HEX_DIGITS[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
-};
-
 class dson_parse_context {
 public:
-    explicit dson_parse_context(const string_view& view) : view_(view) {}
+    dson_parse_context(const string_view& view, bool lazy_number) : view_(view), lazy_number_(lazy_number) {}
 
 public:
     void skip_whitespace() { view_.remove_prefix(min(view_.find_first_not_of(" \t\n\r"), view_.size())); }
@@ -49,8 +37,6 @@ public:
 #endif
 
 private:
-    void encode_utf8(unsigned int u);
-    pair<unsigned int, bool> parse_hex4(string_view& view);
     pair<string, error_type> parse_string();
     error_type parse_null(const shared_ptr<dson_value>& value);
     error_type parse_false(const shared_ptr<dson_value>& value);
@@ -63,6 +49,7 @@ private:
 private:
     string_view view_;
     vector<char> vec_;  // 解析字符串的临时存储
+    bool lazy_number_;
 };
 
 error_type dson_parse_context::parse_null(const shared_ptr<dson_value>& value) {
@@ -101,7 +88,7 @@ error_type dson_parse_context::parse_number(const shared_ptr<dson_value>& value)
         tmp.remove_prefix(1);
     else {
         if (!isdigit(tmp.front())) return error_type::DSON_INVALID_VALUE;
-        tmp.remove_prefix(min(tmp.find_first_not_of("123456789"), tmp.size()));
+        tmp.remove_prefix(min(tmp.find_first_not_of("0123456789"), tmp.size()));
     }
     if (!tmp.empty() && tmp.front() == '.') {
         tmp.remove_prefix(1);
@@ -115,6 +102,14 @@ error_type dson_parse_context::parse_number(const shared_ptr<dson_value>& value)
         if (tmp.empty() || !isdigit(tmp.front())) return error_type::DSON_INVALID_VALUE;
         tmp.remove_prefix(min(tmp.find_first_not_of("0123456789"), tmp.size()));
     }
+    if (lazy_number_) {
+        dson_number number(string_view(view_.data(), tmp.data() - view_.data()));
+        if (number_overflows(number.raw())) return error_type::DSON_NUMBER_TOO_BIG;
+        value->set_option_value(move(number));
+        value->set_type(dson_type::DSON_NUMBER);
+        view_ = tmp;
+        return error_type::DSON_OK;
+    }
     errno = 0;
     value->set_option_value(strtod(view_.data(), nullptr));
     double v = get<double>(value->option_value().value());
@@ -155,23 +150,24 @@ pair<string, error_type> dson_parse_context::parse_string() {
                     case 't': vec_.push_back('\t'); break;
                     case 'u': {
                         tmp.remove_prefix(1);
-                        auto [u, err] = parse_hex4(tmp);
-                        if (!err) return make_pair("", error_type::DSON_INVALID_UNICODE_HEX);
+                        unsigned int u, un;
+                        if (!parse_hex4(tmp.data(), tmp.data() + tmp.size(), u)) return make_pair("", error_type::DSON_INVALID_UNICODE_HEX);
+                        tmp.remove_prefix(4);
                         if (u >= 0xD800 && u <= 0xDBFF) {
                             if (tmp.size() < 2 || tmp[0] != '\\' || tmp[1] != 'u') {
                                 vec_.erase(vec_.begin() + (sz > 0 ? sz - 1 : sz), vec_.end());
                                 return make_pair("", error_type::DSON_INVALID_UNICODE_SURROGATE);
                             }
                             tmp.remove_prefix(2);
-                            auto [un, e] = parse_hex4(tmp);
-                            if (!e) return make_pair("", error_type::DSON_INVALID_UNICODE_HEX);
+                            if (!parse_hex4(tmp.data(), tmp.data() + tmp.size(), un)) return make_pair("", error_type::DSON_INVALID_UNICODE_HEX);
+                            tmp.remove_prefix(4);
                             if (un < 0xDC00 || un > 0xDFFF) {
                                 vec_.erase(vec_.begin() + (sz > 0 ? sz - 1 : sz), vec_.end());
                                 return make_pair("", error_type::DSON_INVALID_UNICODE_SURROGATE);
                             }
                             u = (((u - 0xD800) << 10) | (un - 0xDC00)) + 0x10000;
                         }
-                        encode_utf8(u);
+                        encode_utf8(u, vec_);
                         continue;
                     }
                     default: vec_.erase(vec_.begin() + (sz > 0 ? sz - 1 : sz), vec_.end()); return make_pair("", error_type::DSON_INVALID_STRING_ESCAPE);
@@ -194,7 +190,7 @@ error_type dson_parse_context::parse_string(const shared_ptr<dson_value>& value)
     assert(value);
     auto [str, err] = parse_string();
     if (err == error_type::DSON_OK) {
-        value->set_option_value(str);
+        value->set_option_value(move(str));
         value->set_type(dson_type::DSON_STRING);
     }
     return err;
@@ -224,7 +220,7 @@ error_type dson_parse_context::parse_array(const shared_ptr<dson_value>& value)
         else if (!view_.empty() && view_.front() == ']') {
             view_.remove_prefix(1);
             value->set_type(dson_type::DSON_ARRAY);
-            value->set_option_value(tmp);
+            value->set_option_value(move(tmp));
             return error_type::DSON_OK;
         }
         else
@@ -263,7 +259,7 @@ error_type dson_parse_context::parse_object(const shared_ptr<dson_value>& value)
         }
         else if (!view_.empty() && view_.front() == '}') {
             view_.remove_prefix(1);
-            value->set_option_value(mp);
+            value->set_option_value(move(mp));
             value->set_type(dson_type::DSON_OBJECT);
             return error_type::DSON_OK;
         }
@@ -272,46 +268,6 @@ error_type dson_parse_context::parse_object(const shared_ptr<dson_value>& value)
     }
 }
 
-void dson_parse_context::encode_utf8(unsigned int u) {
-    if (u <= 0x7F)
-        vec_.push_back(u & 0xFF);
-    else if (u <= 0x7FF) {
-        vec_.push_back(0xC0 | ((u >> 6) & 0xFF));
-        vec_.push_back(0x80 | (u & 0x3F));
-    }
-    else if (u <= 0xFFFF) {
-        vec_.push_back(0xE0 | ((u >> 12) & 0xFF));
-        vec_.push_back(0x80 | ((u >> 6) & 0x3F));
-        vec_.push_back(0x80 | (u & 0x3F));
-    }
-    else {
-        assert(u <= 0x10FFFF);
-        vec_.push_back(0xF0 | ((u >> 18) & 0xFF));
-        vec_.push_back(0x80 | ((u >> 12) & 0x3F));
-        vec_.push_back(0x80 | ((u >> 6) & 0x3F));
-        vec_.push_back(0x80 | (u & 0x3F));
-    }
-}
-
-pair<unsigned int, bool> dson_parse_context::parse_hex4(string_view& view) {
-    if (view.size() < 4) return make_pair(0, false);
-    unsigned int u = 0;
-    for (int i = 0; i < 4; ++i) {
-        char ch = view[i];
-        u <<= 4;
-        if (ch >= '0' && ch <= '9')
-            u |= (ch - '0');
-        else if (ch >= 'A' && ch <= 'F')
-            u |= (ch - 'A' + 10);
-        else if (ch >= 'a' && ch <= 'f')
-            u |= (ch - 'a' + 10);
-        else
-            return make_pair(0, false);
-    }
-    view.remove_prefix(4);
-    return make_pair(u, true);
-}
-
 error_type dson_parse_context::parse(const shared_ptr<dson_value>& value) {
     assert(value);
     if (view_.empty()) return error_type::DSON_EXPECT_VALUE;
@@ -326,68 +282,166 @@ error_type dson_parse_context::parse(const shared_ptr<dson_value>& value) {
     }
 }
 
+namespace {
+
+#ifdef DSON_AVX2
+// find_escape over whole 32-byte blocks; stops at the escape or where fewer than 32 bytes are left
+DSON_TARGET("avx2") const char* find_escape_avx2(const char* p, const char* end, bool high) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1F);
+    for (; end - p >= 32; p += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(x, quote), _mm256_cmpeq_epi8(x, backslash));
+        special = _mm256_or_si256(special, _mm256_cmpeq_epi8(_mm256_max_epu8(x, control), control));
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(special));
+        if (high) mask |= static_cast<unsigned int>(_mm256_movemask_epi8(x));
+        if (mask != 0) return p + trailing_zeros(mask);
+    }
+    return p;
+}
+#endif
+
+// First byte of [p, end) that stringify_string cannot copy as is: '"', '\\', a control character
+// and, if high, any byte >= 0x80
+const char* find_escape(const char* p, const char* end, bool high) {
+#ifdef DSON_AVX2
+    if (end - p >= 32 && cpu_has_avx2()) {
+        p = find_escape_avx2(p, end, high);
+        if (end - p >= 32) return p;
+    }
+#endif
+#ifdef DSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, backslash));
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_max_epu8(x, control), control));
+        unsigned int mask = _mm_movemask_epi8(special);
+        if (high) mask |= _mm_movemask_epi8(x);
+        if (mask != 0) return p + trailing_zeros(mask);
+    }
+#endif
+    for (; p != end; ++p) {
+        unsigned char c = *p;
+        if (c == '"' || c == '\\' || c < 0x20 || (high && c >= 0x80)) break;
+    }
+    return p;
+}
+
+}  // namespace
+
+void dson_generate_context::put_unicode(unsigned int u) {
+    char buf[6] = { '\\', 'u', HEX_DIGITS[u >> 12], HEX_DIGITS[(u >> 8) & 15], HEX_DIGITS[(u >> 4) & 15], HEX_DIGITS[u & 15] };
+    out_.append(buf, sizeof(buf));
+}
+
+// Writes the UTF-8 sequence at p as \uXXXX, a surrogate pair above the BMP, and moves past it.
+// An ill-formed byte becomes U+FFFD.
+void dson_generate_context::escape_utf8(const char*& p, const char* end) {
+    const unsigned char* s = reinterpret_cast<const unsigned char*>(p);
+    size_t n = utf8_sequence_length(s, reinterpret_cast<const unsigned char*>(end));
+    if (n == 0) {
+        put_unicode(0xFFFD);
+        ++p;
+        return;
+    }
+    unsigned int u = s[0] & (0x7F >> n);
+    for (size_t i = 1; i < n; ++i) u = (u << 6) | (s[i] & 0x3F);
+    if (u >= 0x10000) {
+        u -= 0x10000;
+        put_unicode(0xD800 + (u >> 10));
+        put_unicode(0xDC00 + (u & 0x3FF));
+    }
+    else
+        put_unicode(u);
+    p += n;
+}
+
 void dson_generate_context::stringify_string(const string& str) {
-    sstream_ << '"';
-    for (unsigned char c : str) {
-        switch (c) {
-            case '\"': sstream_ << "\\\""; break;
-            case '\\': sstream_ << "\\\\"; break;
-            case '\b': sstream_ << "\\b"; break;
-            case '\f': sstream_ << "\\f"; break;
-            case '\n': sstream_ << "\\n"; break;
-            case '\r': sstream_ << "\\r"; break;
-            case '\t': sstream_ << "\\t"; break;
-            default:
-                if (c < 0x20) {
-                    sstream_ << "\\u00";
-                    sstream_ << HEX_DIGITS[c >> 4];
-                    sstream_ << HEX_DIGITS[c & 15];
-                }
-                else
-                    sstream_ << c;
+    out_.reserve(out_.size() + str.size() + 2);
+    out_.push_back('"');
+    const char* p = str.data();
+    const char* end = p + str.size();
+    while (true) {
+        // copy the run that needs no escaping in one go
+        const char* q = find_escape(p, end, escape_unicode_);
+        out_.append(p, q - p);
+        if (q == end) break;
+        unsigned char c = *q;
+        if (c >= 0x80) {
+            escape_utf8(q, end);
+            p = q;
+            continue;
+        }
+        if (c == '"' || c == '\\') {
+            out_.push_back('\\');
+            out_.push_back(static_cast<char>(c));
+        }
+        else if (ESCAPES[c] != 'u') {
+            out_.push_back('\\');
+            out_.push_back(ESCAPES[c]);
         }
+        else
+            put_unicode(c);
+        p = q + 1;
     }
-    sstream_ << '"';
+    out_.push_back('"');
 }
 
-string dson_generate_context::stringify(const shared_ptr<dson_value>& root) {
-    assert(root);
-    switch (root->type()) {
-        case dson_type::DSON_NULL: sstream_ << "null"; break;
-        case dson_type::DSON_FALSE: sstream_ << "false"; break;
-        case dson_type::DSON_TRUE: sstream_ << "true"; break;
-        case dson_type::DSON_NUMBER: sstream_ << get<double>(root->option_value().value()); break;
-        case dson_type::DSON_STRING: stringify_string(get<string>(root->option_value().value())); break;
+void dson_generate_context::stringify_value(const dson_value& value) {
+    switch (value.type()) {
+        case dson_type::DSON_NULL: out_ += "null"; break;
+        case dson_type::DSON_FALSE: out_ += "false"; break;
+        case dson_type::DSON_TRUE: out_ += "true"; break;
+        case dson_type::DSON_NUMBER:
+            if (const auto* number = get_if<dson_number>(&value.option_value().value()))
+                out_ += number->raw();
+            else {
+                // the same digits operator<< gives a double in a default stream
+                char buf[32];
+                int n = snprintf(buf, sizeof(buf), "%g", get<double>(value.option_value().value()));
+                out_.append(buf, n);
+            }
+            break;
+        case dson_type::DSON_STRING: stringify_string(get<string>(value.option_value().value())); break;
         case dson_type::DSON_ARRAY: {
-            sstream_ << '[';
-            auto arr = get<vector<shared_ptr<dson_value>>>(root->option_value().value());
-            for (int i = 0; i < arr.size(); ++i) {
-                if (i > 0) sstream_ << ',';
-                stringify(arr[i]);
+            out_.push_back('[');
+            const auto& arr = get<array_type>(value.option_value().value());
+            for (size_t i = 0; i < arr.size(); ++i) {
+                if (i > 0) out_.push_back(',');
+                stringify_value(*arr[i]);
             }
-            sstream_ << ']';
+            out_.push_back(']');
         } break;
         case dson_type::DSON_OBJECT: {
-            sstream_ << '{';
-            auto obj = get<unordered_map<string, shared_ptr<dson_value>>>(root->option_value().value());
+            out_.push_back('{');
+            const auto& obj = get<object_type>(value.option_value().value());
             auto iter = obj.cbegin();
-            for (int i = 0; i < obj.size(); ++i, ++iter) {
-                if (i > 0) sstream_ << ',';
+            for (size_t i = 0; i < obj.size(); ++i, ++iter) {
+                if (i > 0) out_.push_back(',');
                 stringify_string(iter->first);
-                sstream_ << ':';
-                stringify(iter->second);
+                out_.push_back(':');
+                stringify_value(*iter->second);
             }
-            sstream_ << '}';
+            out_.push_back('}');
         } break;
         default: assert(0 && "invaild type");
     }
-    return sstream_.str();
+}
+
+string dson_generate_context::stringify(const shared_ptr<dson_value>& root) {
+    assert(root);
+    stringify_value(*root);
+    return take();
 }
 
 }  // namespace dson
 
 dson::error_type dson::dson_parser::parse(const std::string_view& json) {
-    dson_parse_context ctx(json);
+    dson_parse_context ctx(json, lazy_number_);
     ctx.skip_whitespace();
     error_type ret = ctx.parse(value_);
     if (ret == error_type::DSON_OK) {
@@ -403,7 +457,17 @@ dson::error_type dson::dson_parser::parse(const std::string_view& json) {
 
 string dson::dson_generator::stringify_raw(const std::shared_ptr<dson_value>& root) {
     assert(root);
-    dson_generate_context ctx;
+    if (pool_) {
+        string json;
+        stringify_raw(root, [&json](const vector<string_view>& buffers) {
+            size_t size = 0;
+            for (const auto& buf : buffers) size += buf.size();
+            json.reserve(size);
+            for (const auto& buf : buffers) json += buf;
+        });
+        return json;
+    }
+    dson_generate_context ctx(escape_unicode_);
     return ctx.stringify(root);
 }
 
@@ -0,0 +1,233 @@
+#pragma once
+
+#include "dson.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DSON_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// SSSE3 and AVX2 code is compiled with per-function target attributes and picked at run time by
+// cpu_has_ssse3()/cpu_has_avx2(), so the default build uses them without any -m flags
+#if defined(DSON_SSE2) && (defined(_MSC_VER) || defined(__GNUC__))
+#define DSON_SSSE3 1
+#define DSON_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define DSON_TARGET(isa)
+#else
+#define DSON_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace dson {
+
+using array_type = std::vector<std::shared_ptr<dson_value>>;
+using object_type = std::unordered_map<std::string, std::shared_ptr<dson_value>>;
+
+inline bool is_whitespace(char ch) { return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r'; }
+
+inline bool is_digit(char ch) { return ch >= '0' && ch <= '9'; }
+
+// Value of a hex digit, -1 if ch is not one
+inline int hex_digit(char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    return -1;
+}
+
+inline int trailing_zeros(unsigned int mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+#ifdef DSON_SSE2
+inline bool cpu_has_ssse3() {
+#if defined(__SSSE3__) || defined(__AVX__)
+    return true;
+#elif defined(_MSC_VER)
+    static const bool has = [] {
+        int regs[4];
+        __cpuid(regs, 1);
+        return (regs[2] & (1 << 9)) != 0;
+    }();
+    return has;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+inline bool cpu_has_avx2() {
+#ifdef __AVX2__
+    return true;
+#elif defined(_MSC_VER)
+    static const bool has = [] {
+        int regs[4];
+        __cpuid(regs, 0);
+        if (regs[0] < 7) return false;
+        // the OS must also save the YMM registers
+        __cpuid(regs, 1);
+        if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) return false;
+        __cpuidex(regs, 7, 0);
+        return (regs[1] & (1 << 5)) != 0;
+    }();
+    return has;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+// Length of the well-formed UTF-8 sequence starting at p, 0 if it is ill-formed
+inline size_t utf8_sequence_length(const unsigned char* p, const unsigned char* end) {
+    unsigned int c = p[0];
+    if (c < 0x80) return 1;
+    if (c < 0xC2 || c > 0xF4) return 0;
+    size_t n = c < 0xE0 ? 2 : (c < 0xF0 ? 3 : 4);
+    if (static_cast<size_t>(end - p) < n) return 0;
+    unsigned int c1 = p[1];
+    if ((c1 & 0xC0) != 0x80) return 0;
+    if ((c == 0xE0 && c1 < 0xA0) || (c == 0xED && c1 > 0x9F) || (c == 0xF0 && c1 < 0x90) || (c == 0xF4 && c1 > 0x8F)) return 0;
+    for (size_t i = 2; i < n; ++i)
+        if ((p[i] & 0xC0) != 0x80) return 0;
+    return n;
+}
+
+// Offset of the first ill-formed byte in [p, p + n), n if the whole range is valid UTF-8
+size_t validate_utf8(const char* p, size_t n);
+
+// Four hex digits at p, false if there are fewer or one is not a hex digit
+inline bool parse_hex4(const char* p, const char* end, unsigned int& u) {
+    if (end - p < 4) return false;
+    u = 0;
+    for (int i = 0; i < 4; ++i) {
+        int digit = hex_digit(p[i]);
+        if (digit < 0) return false;
+        u = (u << 4) | digit;
+    }
+    return true;
+}
+
+// Appends code point u as UTF-8 to out, a std::string or std::vector<char>
+template <typename Out>
+void encode_utf8(unsigned int u, Out& out) {
+    if (u <= 0x7F)
+        out.push_back(static_cast<char>(u));
+    else if (u <= 0x7FF) {
+        out.push_back(static_cast<char>(0xC0 | (u >> 6)));
+        out.push_back(static_cast<char>(0x80 | (u & 0x3F)));
+    }
+    else if (u <= 0xFFFF) {
+        out.push_back(static_cast<char>(0xE0 | (u >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((u >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (u & 0x3F)));
+    }
+    else {
+        assert(u <= 0x10FFFF);
+        out.push_back(static_cast<char>(0xF0 | (u >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((u >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((u >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (u & 0x3F)));
+    }
+}
+
+// token must be a grammatically valid JSON number; true if strtod would return HUGE_VAL for it
+bool number_overflows(const std::string_view& token);
+
+// strtod over a token that need not be null-terminated
+double parse_double(const std::string_view& token);
+
+// Exact value of a finite number as "0" or [-]digits"e"exponent without leading or trailing zero
+// digits, so two numbers are equal exactly when these are, e.g. 1.50 -> "15e-1", -100 -> "-1e2"
+std::string exact_decimal(double d);
+std::string exact_decimal(const dson_number& number);
+
+// Splits a JSON Pointer (RFC 6901) into its unescaped reference tokens
+bool parse_pointer(const std::string_view& path, std::vector<std::string>& tokens);
+
+// Array index token: decimal digits without leading zeros
+bool parse_index(const std::string_view& token, size_t& index);
+
+class dson_generate_context {
+public:
+    // escape_unicode writes every non-ASCII character as \uXXXX, so the output is pure ASCII
+    explicit dson_generate_context(bool escape_unicode = false) : escape_unicode_(escape_unicode) {}
+
+    std::string stringify(const std::shared_ptr<dson_value>& root);
+
+    void stringify_value(const dson_value& value);
+    void stringify_string(const std::string& str);
+
+    void put(char ch) { out_.push_back(ch); }
+
+    // Returns the text written so far and starts over
+    std::string take() {
+        std::string str = std::move(out_);
+        out_.clear();
+        return str;
+    }
+
+private:
+    void escape_utf8(const char*& p, const char* end);
+    void put_unicode(unsigned int u);
+
+private:
+    std::string out_;
+    bool escape_unicode_;
+
+    static constexpr char HEX_DIGITS[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+    // Short escape letter of each control character, 'u' where only \u00XX exists
+    static constexpr char ESCAPES[0x20] = { 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+                                            'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u' };
+};
+
+// Runs the JSON grammar over a view without building any value
+class dson_validate_context {
+public:
+    explicit dson_validate_context(const std::string_view& view) : begin_(view.data()), view_(view) {}
+
+public:
+    void skip_whitespace() {
+        size_t i = 0;
+        while (i < view_.size() && is_whitespace(view_[i])) ++i;
+        view_.remove_prefix(i);
+    }
+
+    error_type validate();
+    error_type validate_string();
+    error_type validate_number();
+
+    bool is_completed() const { return view_.empty(); }
+
+    size_t offset() const { return view_.data() - begin_; }
+
+    std::string_view& view() { return view_; }
+
+private:
+    error_type validate_literal(const char* literal, size_t n);
+    error_type validate_array();
+    error_type validate_object();
+
+private:
+    const char* begin_;
+    std::string_view view_;
+};
+
+}  // namespace dson
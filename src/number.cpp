@@ -0,0 +1,229 @@
+#include "internal.hpp"
+
+#include <cassert>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+namespace dson {
+
+double parse_double(const string_view& token) {
+    char buf[64];
+    if (token.size() < sizeof(buf)) {
+        memcpy(buf, token.data(), token.size());
+        buf[token.size()] = '\0';
+        return strtod(buf, nullptr);
+    }
+    return strtod(string(token).c_str(), nullptr);
+}
+
+dson_number::dson_number(string_view raw) : raw_(raw), flags_(0) {
+    if (!raw_.empty() && raw_.front() == '-') flags_ |= NEGATIVE;
+    for (char ch : raw_) {
+        if (ch == '.')
+            flags_ |= FRACTION;
+        else if (ch == 'e' || ch == 'E')
+            flags_ |= EXPONENT;
+    }
+}
+
+dson_number::dson_number(const dson_number& other) : raw_(other.raw_), text_(other.text_), flags_(other.flags_) {
+    cached_.store(other.cached_.load(memory_order_acquire), memory_order_relaxed);
+    double_.store(other.double_.load(memory_order_relaxed), memory_order_relaxed);
+    int64_.store(other.int64_.load(memory_order_relaxed), memory_order_relaxed);
+    const string* decimal = other.decimal_.load(memory_order_acquire);
+    decimal_.store(decimal ? new string(*decimal) : nullptr, memory_order_relaxed);
+}
+
+dson_number& dson_number::operator=(const dson_number& other) {
+    if (this != &other) {
+        raw_ = other.raw_;
+        text_ = other.text_;
+        flags_ = other.flags_;
+        uint8_t cached = other.cached_.load(memory_order_acquire);
+        double_.store(other.double_.load(memory_order_relaxed), memory_order_relaxed);
+        int64_.store(other.int64_.load(memory_order_relaxed), memory_order_relaxed);
+        cached_.store(cached, memory_order_release);
+        const string* decimal = other.decimal_.load(memory_order_acquire);
+        delete decimal_.exchange(decimal ? new string(*decimal) : nullptr, memory_order_acq_rel);
+    }
+    return *this;
+}
+
+// Concurrent first calls may both convert; they store the same result
+void dson_number::own_text() {
+    if (text_) return;
+    text_ = make_shared<const string>(raw_);
+    raw_ = *text_;
+}
+
+double dson_number::as_double() const {
+    if (cached_.load(memory_order_acquire) & HAS_DOUBLE) return double_.load(memory_order_relaxed);
+    double d = parse_double(raw_);
+    double_.store(d, memory_order_relaxed);
+    cached_.fetch_or(HAS_DOUBLE, memory_order_release);
+    return d;
+}
+
+optional<int64_t> dson_number::as_int64() const {
+    uint8_t cached = cached_.load(memory_order_acquire);
+    if (cached & HAS_INT64) return int64_.load(memory_order_relaxed);
+    if (cached & NOT_INT64) return nullopt;
+    int64_t v = 0;
+    bool ok = false;
+    if (is_integer()) {
+        auto [ptr, ec] = from_chars(raw_.data(), raw_.data() + raw_.size(), v);
+        ok = ec == errc() && ptr == raw_.data() + raw_.size();
+    }
+    else {
+        const string& dec = as_decimal_string();
+        size_t dot = dec.find('.');
+        if (dot == string::npos) dot = dec.size();
+        // as_decimal_string falls back to the raw text for huge exponents
+        if (dec.find_first_of("eE") == string::npos && dec.find_first_not_of('0', min(dot + 1, dec.size())) == string::npos) {
+            auto [ptr, ec] = from_chars(dec.data(), dec.data() + dot, v);
+            ok = ec == errc() && ptr == dec.data() + dot;
+        }
+    }
+    if (!ok) {
+        cached_.fetch_or(NOT_INT64, memory_order_release);
+        return nullopt;
+    }
+    int64_.store(v, memory_order_relaxed);
+    cached_.fetch_or(HAS_INT64, memory_order_release);
+    return v;
+}
+
+// The first of concurrent first calls to publish its string wins, the others drop theirs
+const string& dson_number::as_decimal_string() const {
+    const string* cached = decimal_.load(memory_order_acquire);
+    if (cached) return *cached;
+    string* str = new string(decimal_string());
+    if (decimal_.compare_exchange_strong(cached, str, memory_order_acq_rel, memory_order_acquire)) return *str;
+    delete str;
+    return *cached;
+}
+
+string dson_number::decimal_string() const {
+    if (is_integer()) return string(raw_);
+    size_t i = 0, n = raw_.size();
+    if (is_negative()) ++i;
+    string digits;
+    long long point = 0;
+    while (i < n && is_digit(raw_[i])) digits.push_back(raw_[i++]);
+    point = static_cast<long long>(digits.size());
+    if (i < n && raw_[i] == '.')
+        for (++i; i < n && is_digit(raw_[i]); ++i) digits.push_back(raw_[i]);
+    if (i < n) {
+        bool negative = raw_[++i] == '-';
+        if (raw_[i] == '+' || raw_[i] == '-') ++i;
+        long long exp = 0;
+        for (; i < n; ++i) {
+            exp = exp * 10 + (raw_[i] - '0');
+            if (exp > 1000) return string(raw_);
+        }
+        point += negative ? -exp : exp;
+    }
+    string out;
+    if (is_negative()) out.push_back('-');
+    if (point <= 0) {
+        out += "0.";
+        out.append(static_cast<size_t>(-point), '0');
+        out += digits;
+        return out;
+    }
+    size_t whole = static_cast<size_t>(point);
+    if (whole >= digits.size()) digits.append(whole - digits.size(), '0');
+    // the integer part keeps at most one leading zero
+    size_t k = 0;
+    while (k + 1 < whole && digits[k] == '0') ++k;
+    out.append(digits, k, whole - k);
+    if (whole < digits.size()) {
+        out.push_back('.');
+        out.append(digits, whole, string::npos);
+    }
+    return out;
+}
+
+namespace {
+
+// Multiplies a little-endian base 10^9 number by factor < 2^31
+void multiply(vector<uint32_t>& limbs, uint32_t factor) {
+    uint64_t carry = 0;
+    for (auto& limb : limbs) {
+        uint64_t x = static_cast<uint64_t>(limb) * factor + carry;
+        limb = static_cast<uint32_t>(x % 1000000000);
+        carry = x / 1000000000;
+    }
+    for (; carry != 0; carry /= 1000000000) limbs.push_back(static_cast<uint32_t>(carry % 1000000000));
+}
+
+// digits * 10^exp as "0" or [-]digits"e"exp without leading or trailing zero digits
+string canonical(bool negative, string digits, long long exp) {
+    size_t first = digits.find_first_not_of('0');
+    if (first == string::npos) return "0";
+    size_t last = digits.find_last_not_of('0');
+    exp += static_cast<long long>(digits.size() - 1 - last);
+    string out = negative ? "-" : "";
+    out.append(digits, first, last + 1 - first);
+    out.push_back('e');
+    out += to_string(exp);
+    return out;
+}
+
+}  // namespace
+
+string exact_decimal(double d) {
+    assert(isfinite(d));
+    if (d == 0) return "0";
+    // |d| = m * 2^e2 with a 53-bit m, which is m * 5^-e2 * 10^e2 when e2 < 0
+    int e2;
+    uint64_t m = static_cast<uint64_t>(ldexp(frexp(fabs(d), &e2), 53));
+    e2 -= 53;
+    vector<uint32_t> limbs = { static_cast<uint32_t>(m % 1000000000), static_cast<uint32_t>(m / 1000000000 % 1000000000), static_cast<uint32_t>(m / 1000000000000000000) };
+    long long exp = 0;
+    for (; e2 > 0; e2 -= min(e2, 30)) multiply(limbs, 1u << min(e2, 30));
+    if (e2 < 0) {
+        exp = e2;
+        static const uint32_t POW5[] = { 1, 5, 25, 125, 625, 3125, 15625, 78125, 390625, 1953125, 9765625, 48828125, 244140625, 1220703125 };
+        for (int k = -e2; k > 0; k -= min(k, 13)) multiply(limbs, POW5[min(k, 13)]);
+    }
+    while (limbs.size() > 1 && limbs.back() == 0) limbs.pop_back();
+    string digits = to_string(limbs.back());
+    for (size_t i = limbs.size() - 1; i-- > 0;) {
+        string limb = to_string(limbs[i]);
+        digits.append(9 - limb.size(), '0');
+        digits += limb;
+    }
+    return canonical(d < 0, move(digits), exp);
+}
+
+string exact_decimal(const dson_number& number) {
+    string_view raw = number.raw();
+    size_t i = number.is_negative() ? 1 : 0, n = raw.size();
+    string digits;
+    long long exp = 0;
+    while (i < n && is_digit(raw[i])) digits.push_back(raw[i++]);
+    if (i < n && raw[i] == '.')
+        for (++i; i < n && is_digit(raw[i]); ++i, --exp) digits.push_back(raw[i]);
+    if (i < n) {
+        bool negative = raw[++i] == '-';
+        if (raw[i] == '+' || raw[i] == '-') ++i;
+        // far beyond any exponent a double could reach
+        long long e = 0;
+        for (; i < n; ++i)
+            if (e < 1000000000000000) e = e * 10 + (raw[i] - '0');
+        exp += negative ? -e : e;
+    }
+    return canonical(number.is_negative(), move(digits), exp);
+}
+
+}  // namespace dson
+
+double dson::dson_value::as_double() const {
+    if (const auto* number = get_if<dson_number>(&val_.value())) return number->as_double();
+    return get<double>(val_.value());
+}
@@ -0,0 +1,248 @@
+#include "internal.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace dson {
+
+// Fixed set of worker threads that join the calling thread on one job at a time
+class dson_thread_pool {
+public:
+    // threads counts the caller, so threads - 1 workers are started
+    explicit dson_thread_pool(unsigned threads);
+    ~dson_thread_pool() { stop(); }
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    // Runs job on the caller and up to n - 1 workers and returns once every copy has finished.
+    // The first exception thrown by any of them is rethrown here.
+    void run(const function<void()>& job, unsigned n);
+
+private:
+    void loop();
+    void stop();
+
+private:
+    mutex run_mutex_;  // one job at a time
+    mutex mutex_;
+    condition_variable wake_;
+    condition_variable done_;
+    const function<void()>* job_ = nullptr;
+    unsigned wanted_ = 0;  // workers still to join the job
+    unsigned active_ = 0;  // workers running it
+    bool stopping_ = false;
+    exception_ptr error_;
+    vector<thread> workers_;
+};
+
+dson_thread_pool::dson_thread_pool(unsigned threads) {
+    try {
+        for (unsigned i = 1; i < threads; ++i) workers_.emplace_back(&dson_thread_pool::loop, this);
+    }
+    catch (...) {
+        stop();
+        throw;
+    }
+}
+
+void dson_thread_pool::stop() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : workers_) t.join();
+    workers_.clear();
+}
+
+void dson_thread_pool::loop() {
+    unique_lock<mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stopping_ || wanted_ > 0; });
+        if (stopping_) return;
+        --wanted_;
+        ++active_;
+        const function<void()>* job = job_;
+        lock.unlock();
+        exception_ptr error;
+        try {
+            (*job)();
+        }
+        catch (...) {
+            error = current_exception();
+        }
+        lock.lock();
+        if (error && !error_) error_ = error;
+        if (--active_ == 0) done_.notify_all();
+    }
+}
+
+void dson_thread_pool::run(const function<void()>& job, unsigned n) {
+    lock_guard<mutex> run_lock(run_mutex_);
+    {
+        lock_guard<mutex> lock(mutex_);
+        job_ = &job;
+        wanted_ = min(n, size()) - 1;
+        error_ = nullptr;
+    }
+    wake_.notify_all();
+    exception_ptr error;
+    try {
+        job();
+    }
+    catch (...) {
+        error = current_exception();
+    }
+    unique_lock<mutex> lock(mutex_);
+    // workers that have not started yet are no longer needed
+    wanted_ = 0;
+    done_.wait(lock, [this] { return active_ == 0; });
+    job_ = nullptr;
+    if (!error) error = error_;
+    if (error) rethrow_exception(error);
+}
+
+namespace {
+
+// Splits the output into literal text written while walking the tree and chunks of large
+// containers that are serialized concurrently, each into its own buffer
+class dson_parallel_context {
+public:
+    dson_parallel_context(unsigned threads, size_t grain, bool escape_unicode) : threads_(threads), grain_(grain), escape_unicode_(escape_unicode), literal_(escape_unicode) {}
+
+    // Returns the output buffers in order
+    const vector<string>& run(const dson_value& root, dson_thread_pool& pool);
+
+private:
+    struct chunk {
+        const array_type* arr;
+        const vector<const object_type::value_type*>* members;
+        size_t begin, end;
+        size_t slot;
+    };
+
+private:
+    void plan(const dson_value& value);
+    void split(const array_type* arr, const vector<const object_type::value_type*>* members, size_t size);
+    void flush() { buffers_.push_back(literal_.take()); }
+    void work();
+
+private:
+    unsigned threads_;
+    size_t grain_;
+    bool escape_unicode_;
+    dson_generate_context literal_;
+    vector<string> buffers_;
+    vector<chunk> chunks_;
+    list<vector<const object_type::value_type*>> members_;
+    atomic<size_t> next_{ 0 };
+};
+
+void dson_parallel_context::split(const array_type* arr, const vector<const object_type::value_type*>* members, size_t size) {
+    flush();
+    // several chunks per thread so that uneven elements still balance
+    size_t step = max<size_t>(1, (size + threads_ * 8 - 1) / (threads_ * 8));
+    for (size_t begin = 0; begin < size; begin += step) {
+        chunks_.push_back({ arr, members, begin, min(size, begin + step), buffers_.size() });
+        buffers_.emplace_back();
+    }
+}
+
+void dson_parallel_context::plan(const dson_value& value) {
+    if (value.type() == dson_type::DSON_ARRAY) {
+        const auto& arr = get<array_type>(value.option_value().value());
+        literal_.put('[');
+        if (arr.size() >= grain_)
+            split(&arr, nullptr, arr.size());
+        else
+            for (size_t i = 0; i < arr.size(); ++i) {
+                if (i > 0) literal_.put(',');
+                plan(*arr[i]);
+            }
+        literal_.put(']');
+    }
+    else if (value.type() == dson_type::DSON_OBJECT) {
+        const auto& obj = get<object_type>(value.option_value().value());
+        literal_.put('{');
+        if (obj.size() >= grain_) {
+            // chunks index members in iteration order, which is the order the sequential path uses
+            auto& members = members_.emplace_back();
+            members.reserve(obj.size());
+            for (const auto& kv : obj) members.push_back(&kv);
+            split(nullptr, &members, members.size());
+        }
+        else {
+            auto iter = obj.cbegin();
+            for (size_t i = 0; i < obj.size(); ++i, ++iter) {
+                if (i > 0) literal_.put(',');
+                literal_.stringify_string(iter->first);
+                literal_.put(':');
+                plan(*iter->second);
+            }
+        }
+        literal_.put('}');
+    }
+    else
+        literal_.stringify_value(value);
+}
+
+void dson_parallel_context::work() {
+    dson_generate_context ctx(escape_unicode_);
+    for (size_t i = next_++; i < chunks_.size(); i = next_++) {
+        const chunk& c = chunks_[i];
+        for (size_t k = c.begin; k < c.end; ++k) {
+            if (k > 0) ctx.put(',');
+            if (c.arr)
+                ctx.stringify_value(*(*c.arr)[k]);
+            else {
+                ctx.stringify_string((*c.members)[k]->first);
+                ctx.put(':');
+                ctx.stringify_value(*(*c.members)[k]->second);
+            }
+        }
+        buffers_[c.slot] = ctx.take();
+    }
+}
+
+const vector<string>& dson_parallel_context::run(const dson_value& root, dson_thread_pool& pool) {
+    plan(root);
+    flush();
+    if (!chunks_.empty()) pool.run([this] { work(); }, static_cast<unsigned>(min<size_t>(threads_, chunks_.size())));
+    return buffers_;
+}
+
+}  // namespace
+
+}  // namespace dson
+
+void dson::dson_generator::set_parallel(unsigned threads, size_t grain) {
+    if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+    grain_ = grain;
+    pool_ = threads > 1 ? make_shared<dson_thread_pool>(threads) : nullptr;
+}
+
+void dson::dson_generator::stringify_raw(const shared_ptr<dson_value>& root, const function<void(const vector<string_view>&)>& sink) {
+    assert(root);
+    vector<string_view> views;
+    if (!pool_) {
+        dson_generate_context ctx(escape_unicode_);
+        string json = ctx.stringify(root);
+        views.push_back(json);
+        sink(views);
+        return;
+    }
+    unsigned threads = pool_->size();
+    dson_parallel_context ctx(threads, max<size_t>(grain_, 1), escape_unicode_);
+    const auto& buffers = ctx.run(*root, *pool_);
+    views.reserve(buffers.size());
+    for (const auto& buf : buffers)
+        if (!buf.empty()) views.push_back(buf);
+    sink(views);
+}
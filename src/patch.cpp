@@ -0,0 +1,604 @@
+#include "internal.hpp"
+
+#include <cassert>
+#include <functional>
+
+using namespace std;
+
+namespace dson {
+
+namespace {
+
+size_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return static_cast<size_t>(x);
+}
+
+size_t combine(size_t seed, size_t h) { return mix(seed ^ (h + 0x9E3779B97F4A7C15ULL + (seed << 6) + (seed >> 2))); }
+
+// child is called for the hash of every direct child, so callers can memoize it
+template <typename ChildHash>
+size_t hash_node(const dson_value& v, ChildHash&& child) {
+    size_t h = static_cast<size_t>(v.type()) + 1;
+    switch (v.type()) {
+        case dson_type::DSON_NUMBER: {
+            // numbers with equal exact values round to the same double
+            double d = v.as_double();
+            return combine(h, std::hash<double>()(d == 0 ? 0.0 : d));
+        }
+        case dson_type::DSON_STRING: return combine(h, std::hash<string>()(get<string>(v.option_value().value())));
+        case dson_type::DSON_ARRAY: {
+            const auto& arr = get<array_type>(v.option_value().value());
+            for (const auto& e : arr) h = combine(h, child(*e));
+            return combine(h, arr.size());
+        }
+        case dson_type::DSON_OBJECT: {
+            // members are unordered, so their hashes are summed
+            const auto& obj = get<object_type>(v.option_value().value());
+            size_t sum = obj.size();
+            for (const auto& kv : obj) sum += combine(std::hash<string>()(kv.first), child(*kv.second));
+            return combine(h, sum);
+        }
+        default: return mix(h);
+    }
+}
+
+// Decided on the exact values. Equal values round to the same double, so the doubles (which hash()
+// also uses) settle most pairs and the exact text is only built for a lazy number that ties.
+bool number_equal(const dson_value& lhs, const dson_value& rhs) {
+    if (lhs.as_double() != rhs.as_double()) return false;
+    const auto* a = get_if<dson_number>(&lhs.option_value().value());
+    const auto* b = get_if<dson_number>(&rhs.option_value().value());
+    if (!a && !b) return true;
+    if (a && b && a->raw() == b->raw()) return true;
+    return (a ? exact_decimal(*a) : exact_decimal(lhs.as_double())) == (b ? exact_decimal(*b) : exact_decimal(rhs.as_double()));
+}
+
+// Lazy numbers get their own text, since the source may be a patch whose input is freed soon after
+shared_ptr<dson_value> deep_copy(const dson_value& v) {
+    auto copy = make_shared<dson_value>(v);
+    if (v.type() == dson_type::DSON_NUMBER) {
+        if (auto* n = get_if<dson_number>(&copy->option_value().value())) n->own_text();
+    }
+    else if (v.type() == dson_type::DSON_ARRAY)
+        for (auto& e : get<array_type>(copy->option_value().value())) e = deep_copy(*e);
+    else if (v.type() == dson_type::DSON_OBJECT)
+        for (auto& kv : get<object_type>(copy->option_value().value())) kv.second = deep_copy(*kv.second);
+    return copy;
+}
+
+shared_ptr<dson_value> make_string(string str) {
+    auto v = make_shared<dson_value>();
+    v->set_option_value(move(str));
+    v->set_type(dson_type::DSON_STRING);
+    return v;
+}
+
+const dson_value* find_member(const object_type& obj, const string& key) {
+    auto iter = obj.find(key);
+    return iter == obj.end() ? nullptr : iter->second.get();
+}
+
+const string* find_string_member(const object_type& obj, const string& key) {
+    const dson_value* v = find_member(obj, key);
+    if (!v || v->type() != dson_type::DSON_STRING) return nullptr;
+    return &get<string>(v->option_value().value());
+}
+
+class dson_patch_context {
+public:
+    explicit dson_patch_context(const shared_ptr<dson_value>& root) : root_(root) {}
+
+    error_type apply(const dson_value& op);
+
+    // Undoes every operation applied so far
+    void rollback();
+
+private:
+    enum class undo_kind { ROOT, ARRAY_INSERT, ARRAY_ERASE, ARRAY_REPLACE, OBJECT_SET };
+
+    struct undo_entry {
+        undo_kind kind;
+        dson_value* parent;
+        size_t index;
+        string key;
+        shared_ptr<dson_value> old;  // erased or overwritten value, nullptr if there was none
+    };
+
+private:
+    dson_value* resolve(const vector<string>& tokens, size_t count);
+    error_type replace_root(shared_ptr<dson_value> value);
+    error_type add(const vector<string>& tokens, shared_ptr<dson_value> value);
+    error_type remove(const vector<string>& tokens, shared_ptr<dson_value>& removed);
+    error_type replace(const vector<string>& tokens, shared_ptr<dson_value> value);
+
+private:
+    shared_ptr<dson_value> root_;
+    vector<undo_entry> undo_;
+};
+
+dson_value* dson_patch_context::resolve(const vector<string>& tokens, size_t count) {
+    dson_value* node = root_.get();
+    for (size_t i = 0; i < count; ++i) {
+        if (node->type() == dson_type::DSON_ARRAY) {
+            auto& arr = get<array_type>(node->option_value().value());
+            size_t index;
+            if (!parse_index(tokens[i], index) || index >= arr.size()) return nullptr;
+            node = arr[index].get();
+        }
+        else if (node->type() == dson_type::DSON_OBJECT) {
+            auto& obj = get<object_type>(node->option_value().value());
+            auto iter = obj.find(tokens[i]);
+            if (iter == obj.end()) return nullptr;
+            node = iter->second.get();
+        }
+        else
+            return nullptr;
+    }
+    return node;
+}
+
+error_type dson_patch_context::replace_root(shared_ptr<dson_value> value) {
+    undo_.push_back({ undo_kind::ROOT, nullptr, 0, string(), make_shared<dson_value>(move(*root_)) });
+    // value may be a node that a move op removed and an undo entry still holds, so it is copied
+    // rather than emptied; the copy shares its children
+    *root_ = *value;
+    return error_type::DSON_OK;
+}
+
+error_type dson_patch_context::add(const vector<string>& tokens, shared_ptr<dson_value> value) {
+    if (tokens.empty()) return replace_root(move(value));
+    dson_value* parent = resolve(tokens, tokens.size() - 1);
+    if (!parent) return error_type::DSON_POINTER_NOT_FOUND;
+    const string& token = tokens.back();
+    if (parent->type() == dson_type::DSON_ARRAY) {
+        auto& arr = get<array_type>(parent->option_value().value());
+        size_t index = arr.size();
+        if (token != "-" && !parse_index(token, index)) return error_type::DSON_INVALID_POINTER;
+        if (index > arr.size()) return error_type::DSON_POINTER_NOT_FOUND;
+        arr.insert(arr.begin() + index, move(value));
+        undo_.push_back({ undo_kind::ARRAY_INSERT, parent, index, string(), nullptr });
+    }
+    else if (parent->type() == dson_type::DSON_OBJECT) {
+        auto& slot = get<object_type>(parent->option_value().value())[token];
+        undo_.push_back({ undo_kind::OBJECT_SET, parent, 0, token, move(slot) });
+        slot = move(value);
+    }
+    else
+        return error_type::DSON_POINTER_NOT_FOUND;
+    return error_type::DSON_OK;
+}
+
+error_type dson_patch_context::remove(const vector<string>& tokens, shared_ptr<dson_value>& removed) {
+    if (tokens.empty()) return error_type::DSON_INVALID_POINTER;
+    dson_value* parent = resolve(tokens, tokens.size() - 1);
+    if (!parent) return error_type::DSON_POINTER_NOT_FOUND;
+    const string& token = tokens.back();
+    if (parent->type() == dson_type::DSON_ARRAY) {
+        auto& arr = get<array_type>(parent->option_value().value());
+        size_t index;
+        if (!parse_index(token, index)) return error_type::DSON_INVALID_POINTER;
+        if (index >= arr.size()) return error_type::DSON_POINTER_NOT_FOUND;
+        removed = arr[index];
+        arr.erase(arr.begin() + index);
+        undo_.push_back({ undo_kind::ARRAY_ERASE, parent, index, string(), removed });
+    }
+    else if (parent->type() == dson_type::DSON_OBJECT) {
+        auto& obj = get<object_type>(parent->option_value().value());
+        auto iter = obj.find(token);
+        if (iter == obj.end()) return error_type::DSON_POINTER_NOT_FOUND;
+        removed = iter->second;
+        obj.erase(iter);
+        undo_.push_back({ undo_kind::OBJECT_SET, parent, 0, token, removed });
+    }
+    else
+        return error_type::DSON_POINTER_NOT_FOUND;
+    return error_type::DSON_OK;
+}
+
+error_type dson_patch_context::replace(const vector<string>& tokens, shared_ptr<dson_value> value) {
+    if (tokens.empty()) return replace_root(move(value));
+    dson_value* parent = resolve(tokens, tokens.size() - 1);
+    if (!parent) return error_type::DSON_POINTER_NOT_FOUND;
+    const string& token = tokens.back();
+    if (parent->type() == dson_type::DSON_ARRAY) {
+        auto& arr = get<array_type>(parent->option_value().value());
+        size_t index;
+        if (!parse_index(token, index)) return error_type::DSON_INVALID_POINTER;
+        if (index >= arr.size()) return error_type::DSON_POINTER_NOT_FOUND;
+        undo_.push_back({ undo_kind::ARRAY_REPLACE, parent, index, string(), move(arr[index]) });
+        arr[index] = move(value);
+    }
+    else if (parent->type() == dson_type::DSON_OBJECT) {
+        auto& obj = get<object_type>(parent->option_value().value());
+        auto iter = obj.find(token);
+        if (iter == obj.end()) return error_type::DSON_POINTER_NOT_FOUND;
+        undo_.push_back({ undo_kind::OBJECT_SET, parent, 0, token, move(iter->second) });
+        iter->second = move(value);
+    }
+    else
+        return error_type::DSON_POINTER_NOT_FOUND;
+    return error_type::DSON_OK;
+}
+
+error_type dson_patch_context::apply(const dson_value& op) {
+    if (op.type() != dson_type::DSON_OBJECT) return error_type::DSON_INVALID_PATCH;
+    const auto& obj = get<object_type>(op.option_value().value());
+    const string* name = find_string_member(obj, "op");
+    const string* path = find_string_member(obj, "path");
+    if (!name || !path) return error_type::DSON_INVALID_PATCH;
+    vector<string> tokens;
+    if (!parse_pointer(*path, tokens)) return error_type::DSON_INVALID_POINTER;
+
+    if (*name == "add" || *name == "replace" || *name == "test") {
+        const dson_value* value = find_member(obj, "value");
+        if (!value) return error_type::DSON_INVALID_PATCH;
+        if (*name == "add") return add(tokens, deep_copy(*value));
+        if (*name == "replace") return replace(tokens, deep_copy(*value));
+        const dson_value* target = resolve(tokens, tokens.size());
+        if (!target) return error_type::DSON_POINTER_NOT_FOUND;
+        return *target == *value ? error_type::DSON_OK : error_type::DSON_PATCH_TEST_FAILED;
+    }
+    if (*name == "remove") {
+        shared_ptr<dson_value> removed;
+        return remove(tokens, removed);
+    }
+    if (*name == "move" || *name == "copy") {
+        const string* from = find_string_member(obj, "from");
+        if (!from) return error_type::DSON_INVALID_PATCH;
+        vector<string> from_tokens;
+        if (!parse_pointer(*from, from_tokens)) return error_type::DSON_INVALID_POINTER;
+        if (*name == "copy") {
+            const dson_value* source = resolve(from_tokens, from_tokens.size());
+            if (!source) return error_type::DSON_POINTER_NOT_FOUND;
+            return add(tokens, deep_copy(*source));
+        }
+        if (from_tokens == tokens) return resolve(tokens, tokens.size()) ? error_type::DSON_OK : error_type::DSON_POINTER_NOT_FOUND;
+        // a value cannot be moved into one of its own children
+        if (from_tokens.size() < tokens.size() && std::equal(from_tokens.begin(), from_tokens.end(), tokens.begin())) return error_type::DSON_INVALID_PATCH;
+        shared_ptr<dson_value> value;
+        error_type err = remove(from_tokens, value);
+        if (err != error_type::DSON_OK) return err;
+        return add(tokens, move(value));
+    }
+    return error_type::DSON_INVALID_PATCH;
+}
+
+void dson_patch_context::rollback() {
+    for (auto iter = undo_.rbegin(); iter != undo_.rend(); ++iter) {
+        undo_entry& e = *iter;
+        switch (e.kind) {
+            case undo_kind::ROOT: *root_ = move(*e.old); break;
+            case undo_kind::ARRAY_INSERT: {
+                auto& arr = get<array_type>(e.parent->option_value().value());
+                arr.erase(arr.begin() + e.index);
+            } break;
+            case undo_kind::ARRAY_ERASE: {
+                auto& arr = get<array_type>(e.parent->option_value().value());
+                arr.insert(arr.begin() + e.index, move(e.old));
+            } break;
+            case undo_kind::ARRAY_REPLACE: get<array_type>(e.parent->option_value().value())[e.index] = move(e.old); break;
+            case undo_kind::OBJECT_SET: {
+                auto& obj = get<object_type>(e.parent->option_value().value());
+                if (e.old)
+                    obj[e.key] = move(e.old);
+                else
+                    obj.erase(e.key);
+            } break;
+        }
+    }
+    undo_.clear();
+}
+
+void merge_patch(dson_value& target, const dson_value& patch) {
+    if (patch.type() != dson_type::DSON_OBJECT) {
+        target = move(*deep_copy(patch));
+        return;
+    }
+    if (target.type() != dson_type::DSON_OBJECT) {
+        target.set_option_value(object_type());
+        target.set_type(dson_type::DSON_OBJECT);
+    }
+    auto& obj = get<object_type>(target.option_value().value());
+    for (const auto& kv : get<object_type>(patch.option_value().value())) {
+        if (kv.second->type() == dson_type::DSON_NULL) {
+            obj.erase(kv.first);
+            continue;
+        }
+        auto& slot = obj[kv.first];
+        if (!slot) slot = make_shared<dson_value>();
+        merge_patch(*slot, *kv.second);
+    }
+}
+
+// Largest middle section of two arrays that is aligned with a full LCS table
+constexpr size_t LCS_LIMIT = 1 << 20;
+
+class dson_diff_context {
+public:
+    shared_ptr<dson_value> diff(const shared_ptr<dson_value>& a, const shared_ptr<dson_value>& b);
+
+private:
+    size_t hash(const dson_value& v);
+    size_t class_of(const dson_value& v);
+    bool same_shape(const dson_value& a, const dson_value& b);
+    // O(1) once both subtrees have a class
+    bool equal(const dson_value& a, const dson_value& b) { return &a == &b || class_of(a) == class_of(b); }
+    void emit(const char* op, const string& path, const shared_ptr<dson_value>& value);
+    void diff_value(const shared_ptr<dson_value>& a, const shared_ptr<dson_value>& b, string& path);
+    void diff_array(const array_type& a, const array_type& b, string& path);
+    void diff_object(const object_type& a, const object_type& b, string& path);
+
+private:
+    unordered_map<const dson_value*, size_t> hashes_;
+    // equal subtrees share a class; a node's class is decided by comparing its children's classes,
+    // so every node is compared against a representative at most once per hash bucket entry
+    unordered_map<const dson_value*, size_t> classes_;
+    unordered_map<size_t, vector<const dson_value*>> representatives_;  // by subtree hash
+    size_t class_count_ = 0;
+    array_type ops_;
+};
+
+void append_token(string& path, const string& token) {
+    path.push_back('/');
+    for (char ch : token) {
+        if (ch == '~')
+            path += "~0";
+        else if (ch == '/')
+            path += "~1";
+        else
+            path.push_back(ch);
+    }
+}
+
+size_t dson_diff_context::hash(const dson_value& v) {
+    auto iter = hashes_.find(&v);
+    if (iter != hashes_.end()) return iter->second;
+    size_t h = hash_node(v, [this](const dson_value& child) { return hash(child); });
+    hashes_.emplace(&v, h);
+    return h;
+}
+
+// a and b hash equal; compares one level, children by class
+bool dson_diff_context::same_shape(const dson_value& a, const dson_value& b) {
+    if (a.type() != b.type()) return false;
+    if (a.type() == dson_type::DSON_ARRAY) {
+        const auto& x = get<array_type>(a.option_value().value());
+        const auto& y = get<array_type>(b.option_value().value());
+        if (x.size() != y.size()) return false;
+        for (size_t i = 0; i < x.size(); ++i)
+            if (!equal(*x[i], *y[i])) return false;
+        return true;
+    }
+    if (a.type() == dson_type::DSON_OBJECT) {
+        const auto& x = get<object_type>(a.option_value().value());
+        const auto& y = get<object_type>(b.option_value().value());
+        if (x.size() != y.size()) return false;
+        for (const auto& kv : x) {
+            auto iter = y.find(kv.first);
+            if (iter == y.end() || !equal(*kv.second, *iter->second)) return false;
+        }
+        return true;
+    }
+    return a == b;
+}
+
+size_t dson_diff_context::class_of(const dson_value& v) {
+    auto iter = classes_.find(&v);
+    if (iter != classes_.end()) return iter->second;
+    // children first, so that same_shape only looks classes up and never recurses into a bucket
+    // that is being walked, even when a child collides with its parent's hash
+    if (v.type() == dson_type::DSON_ARRAY)
+        for (const auto& e : get<array_type>(v.option_value().value())) class_of(*e);
+    else if (v.type() == dson_type::DSON_OBJECT)
+        for (const auto& kv : get<object_type>(v.option_value().value())) class_of(*kv.second);
+    auto& reps = representatives_[hash(v)];
+    for (const dson_value* rep : reps)
+        if (same_shape(v, *rep)) {
+            size_t id = classes_.at(rep);
+            classes_.emplace(&v, id);
+            return id;
+        }
+    size_t id = class_count_++;
+    reps.push_back(&v);
+    classes_.emplace(&v, id);
+    return id;
+}
+
+void dson_diff_context::emit(const char* op, const string& path, const shared_ptr<dson_value>& value) {
+    auto v = make_shared<dson_value>();
+    v->set_type(dson_type::DSON_OBJECT);
+    auto& obj = get<object_type>(v->option_value().emplace(in_place_type<object_type>));
+    obj.emplace("op", make_string(op));
+    obj.emplace("path", make_string(path));
+    if (value) obj.emplace("value", value);
+    ops_.push_back(move(v));
+}
+
+void dson_diff_context::diff_value(const shared_ptr<dson_value>& a, const shared_ptr<dson_value>& b, string& path) {
+    if (equal(*a, *b)) return;
+    if (a->type() == dson_type::DSON_ARRAY && b->type() == dson_type::DSON_ARRAY)
+        diff_array(get<array_type>(a->option_value().value()), get<array_type>(b->option_value().value()), path);
+    else if (a->type() == dson_type::DSON_OBJECT && b->type() == dson_type::DSON_OBJECT)
+        diff_object(get<object_type>(a->option_value().value()), get<object_type>(b->option_value().value()), path);
+    else
+        emit("replace", path, b);
+}
+
+void dson_diff_context::diff_object(const object_type& a, const object_type& b, string& path) {
+    size_t len = path.size();
+    for (const auto& kv : a) {
+        if (b.count(kv.first)) continue;
+        append_token(path, kv.first);
+        emit("remove", path, nullptr);
+        path.resize(len);
+    }
+    for (const auto& kv : b) {
+        auto iter = a.find(kv.first);
+        append_token(path, kv.first);
+        if (iter == a.end())
+            emit("add", path, kv.second);
+        else
+            diff_value(iter->second, kv.second, path);
+        path.resize(len);
+    }
+}
+
+void dson_diff_context::diff_array(const array_type& a, const array_type& b, string& path) {
+    size_t n = a.size(), m = b.size(), prefix = 0, suffix = 0;
+    while (prefix < n && prefix < m && equal(*a[prefix], *b[prefix])) ++prefix;
+    while (suffix < n - prefix && suffix < m - prefix && equal(*a[n - 1 - suffix], *b[m - 1 - suffix])) ++suffix;
+    size_t rows = n - prefix - suffix, cols = m - prefix - suffix;
+
+    // edit script over the middle sections: 'm'atch, 'd'elete from a, 'i'nsert from b
+    string script;
+    if (rows > 0 && cols > 0 && rows * cols <= LCS_LIMIT) {
+        vector<uint32_t> lcs((rows + 1) * (cols + 1), 0);
+        auto at = [&](size_t i, size_t j) -> uint32_t& { return lcs[i * (cols + 1) + j]; };
+        for (size_t i = rows; i-- > 0;)
+            for (size_t j = cols; j-- > 0;) at(i, j) = equal(*a[prefix + i], *b[prefix + j]) ? at(i + 1, j + 1) + 1 : max(at(i + 1, j), at(i, j + 1));
+        size_t i = 0, j = 0;
+        while (i < rows && j < cols) {
+            if (at(i, j) == at(i + 1, j + 1) + 1 && equal(*a[prefix + i], *b[prefix + j])) {
+                script.push_back('m');
+                ++i, ++j;
+            }
+            else if (at(i + 1, j) >= at(i, j + 1)) {
+                script.push_back('d');
+                ++i;
+            }
+            else {
+                script.push_back('i');
+                ++j;
+            }
+        }
+        script.append(rows - i, 'd');
+        script.append(cols - j, 'i');
+        // each run of changes costs max(deletions, insertions) operations; fall back to patching
+        // element by element when that is no more expensive
+        size_t cost = 0, deleted = 0, inserted = 0;
+        for (char step : script + 'm') {
+            if (step == 'd')
+                ++deleted;
+            else if (step == 'i')
+                ++inserted;
+            else {
+                cost += max(deleted, inserted);
+                deleted = inserted = 0;
+            }
+        }
+        if (cost >= max(rows, cols)) script.clear();
+    }
+    if (script.empty()) {
+        script.append(rows, 'd');
+        script.append(cols, 'i');
+    }
+    script.push_back('m');  // flushes the last run
+
+    size_t len = path.size(), pos = prefix, i = prefix, j = prefix;
+    vector<size_t> dels, ins;
+    for (char step : script) {
+        if (step == 'd') {
+            dels.push_back(i++);
+            continue;
+        }
+        if (step == 'i') {
+            ins.push_back(j++);
+            continue;
+        }
+        // pair deletions with insertions so that changed elements are patched rather than replaced
+        size_t k = min(dels.size(), ins.size());
+        for (size_t t = 0; t < dels.size() || t < ins.size(); ++t) {
+            path.resize(len);
+            append_token(path, to_string(pos));
+            if (t < k) {
+                diff_value(a[dels[t]], b[ins[t]], path);
+                ++pos;
+            }
+            else if (t < dels.size())
+                emit("remove", path, nullptr);
+            else {
+                emit("add", path, b[ins[t]]);
+                ++pos;
+            }
+        }
+        path.resize(len);
+        dels.clear();
+        ins.clear();
+        ++i, ++j, ++pos;
+    }
+}
+
+shared_ptr<dson_value> dson_diff_context::diff(const shared_ptr<dson_value>& a, const shared_ptr<dson_value>& b) {
+    string path;
+    diff_value(a, b, path);
+    auto patch = make_shared<dson_value>();
+    patch->set_option_value(move(ops_));
+    patch->set_type(dson_type::DSON_ARRAY);
+    return patch;
+}
+
+}  // namespace
+
+size_t dson_value::hash() const {
+    return hash_node(*this, [](const dson_value& child) { return child.hash(); });
+}
+
+bool operator==(const dson_value& lhs, const dson_value& rhs) {
+    if (&lhs == &rhs) return true;
+    if (lhs.type() != rhs.type()) return false;
+    switch (lhs.type()) {
+        case dson_type::DSON_NUMBER: return number_equal(lhs, rhs);
+        case dson_type::DSON_STRING: return get<string>(lhs.val_.value()) == get<string>(rhs.val_.value());
+        case dson_type::DSON_ARRAY: {
+            const auto& a = get<array_type>(lhs.val_.value());
+            const auto& b = get<array_type>(rhs.val_.value());
+            if (a.size() != b.size()) return false;
+            for (size_t i = 0; i < a.size(); ++i)
+                if (a[i] != b[i] && *a[i] != *b[i]) return false;
+            return true;
+        }
+        case dson_type::DSON_OBJECT: {
+            const auto& a = get<object_type>(lhs.val_.value());
+            const auto& b = get<object_type>(rhs.val_.value());
+            if (a.size() != b.size()) return false;
+            for (const auto& kv : a) {
+                auto iter = b.find(kv.first);
+                if (iter == b.end() || (kv.second != iter->second && *kv.second != *iter->second)) return false;
+            }
+            return true;
+        }
+        default: return true;
+    }
+}
+
+}  // namespace dson
+
+dson::error_type dson::apply_patch(const shared_ptr<dson_value>& root, const shared_ptr<const dson_value>& patch) {
+    assert(root && patch);
+    if (patch->type() != dson_type::DSON_ARRAY) return error_type::DSON_INVALID_PATCH;
+    dson_patch_context ctx(root);
+    for (const auto& op : get<array_type>(patch->option_value().value())) {
+        error_type err = ctx.apply(*op);
+        if (err != error_type::DSON_OK) {
+            ctx.rollback();
+            return err;
+        }
+    }
+    return error_type::DSON_OK;
+}
+
+void dson::apply_merge_patch(const shared_ptr<dson_value>& root, const shared_ptr<const dson_value>& patch) {
+    assert(root && patch);
+    merge_patch(*root, *patch);
+}
+
+shared_ptr<dson::dson_value> dson::diff(const shared_ptr<const dson_value>& a, const shared_ptr<const dson_value>& b) {
+    assert(a && b);
+    dson_diff_context ctx;
+    return ctx.diff(const_pointer_cast<dson_value>(a), const_pointer_cast<dson_value>(b));
+}
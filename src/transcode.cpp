@@ -0,0 +1,415 @@
+#include "internal.hpp"
+
+#include <cassert>
+#include <cstring>
+
+using namespace std;
+
+namespace dson {
+
+namespace {
+
+class string_out {
+public:
+    explicit string_out(string& str) : str_(str) {}
+
+    void write(const char* p, size_t n) { str_.append(p, n); }
+    void put(char ch) { str_.push_back(ch); }
+    void fill(char ch, size_t n) { str_.append(n, ch); }
+
+private:
+    string& str_;
+};
+
+// Minified output never outgrows the input consumed so far, so it can trail the read position
+class inplace_out {
+public:
+    explicit inplace_out(char* dst) : dst_(dst) {}
+
+    void write(const char* p, size_t n) {
+        if (dst_ != p) memmove(dst_, p, n);
+        dst_ += n;
+    }
+    void put(char ch) { *dst_++ = ch; }
+    void fill(char ch, size_t n) {
+        memset(dst_, ch, n);
+        dst_ += n;
+    }
+
+    char* end() const { return dst_; }
+
+private:
+    char* dst_;
+};
+
+// First '"', '\\' or control character in [p, end)
+const char* find_string_special(const char* p, const char* end) {
+#ifdef DSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, backslash)), _mm_cmpeq_epi8(_mm_max_epu8(x, control), control));
+        unsigned int mask = _mm_movemask_epi8(special);
+        if (mask != 0) return p + trailing_zeros(mask);
+    }
+#endif
+    while (p != end && *p != '"' && *p != '\\' && static_cast<unsigned char>(*p) >= 0x20) ++p;
+    return p;
+}
+
+inline bool is_structural(char ch) { return static_cast<unsigned char>(ch) <= 0x20 || ch == '"' || ch == ',' || ch == ':' || ch == '[' || ch == ']' || ch == '{' || ch == '}'; }
+
+// End of the scalar token starting at p: the first whitespace, control or structural byte
+const char* find_scalar_end(const char* p, const char* end) {
+#ifdef DSON_SSE2
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i colon = _mm_set1_epi8(':');
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        // '[' | 0x20 == '{' and ']' | 0x20 == '}'
+        __m128i folded = _mm_or_si128(x, space);
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, space), space), _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)));
+        special = _mm_or_si128(special, _mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_or_si128(_mm_cmpeq_epi8(x, comma), _mm_cmpeq_epi8(x, colon))));
+        unsigned int mask = _mm_movemask_epi8(special);
+        if (mask != 0) return p + trailing_zeros(mask);
+    }
+#endif
+    while (p != end && !is_structural(*p)) ++p;
+    return p;
+}
+
+const char* skip_whitespace(const char* p, const char* end) {
+#ifdef DSON_SSE2
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, space), _mm_cmpeq_epi8(x, tab)), _mm_or_si128(_mm_cmpeq_epi8(x, lf), _mm_cmpeq_epi8(x, cr)));
+        unsigned int mask = ~_mm_movemask_epi8(ws) & 0xFFFF;
+        if (mask != 0) return p + trailing_zeros(mask);
+    }
+#endif
+    while (p != end && is_whitespace(*p)) ++p;
+    return p;
+}
+
+error_type miss_separator(char open) { return open == '[' ? error_type::DSON_MISS_COMMA_OR_SQUARE_BRACKET : error_type::DSON_MISS_COMMA_OR_CURLY_BRACKET; }
+
+}  // namespace
+
+// Checks one byte of an escape sequence, the one after the backslash onwards
+void dson_transcoder::escape(char ch) {
+    switch (escape_) {
+        case ESCAPE_START:
+            if (ch == 'u') {
+                escape_ = ESCAPE_HEX;
+                hex_left_ = 4;
+                hex_ = 0;
+            }
+            else if (ch == '"' || ch == '\\' || ch == '/' || ch == 'b' || ch == 'f' || ch == 'n' || ch == 'r' || ch == 't')
+                escape_ = ESCAPE_NONE;
+            else
+                error_ = error_type::DSON_INVALID_STRING_ESCAPE;
+            break;
+        case ESCAPE_HEX: {
+            int digit = hex_digit(ch);
+            if (digit < 0) {
+                error_ = error_type::DSON_INVALID_UNICODE_HEX;
+                break;
+            }
+            hex_ = (hex_ << 4) | digit;
+            if (--hex_left_ > 0) break;
+            if (low_surrogate_) {
+                low_surrogate_ = false;
+                if (hex_ < 0xDC00 || hex_ > 0xDFFF) error_ = error_type::DSON_INVALID_UNICODE_SURROGATE;
+                escape_ = ESCAPE_NONE;
+            }
+            else
+                escape_ = hex_ >= 0xD800 && hex_ <= 0xDBFF ? ESCAPE_LOW_BACKSLASH : ESCAPE_NONE;
+        } break;
+        case ESCAPE_LOW_BACKSLASH:
+            if (ch != '\\')
+                error_ = error_type::DSON_INVALID_UNICODE_SURROGATE;
+            else
+                escape_ = ESCAPE_LOW_U;
+            break;
+        case ESCAPE_LOW_U:
+            if (ch != 'u')
+                error_ = error_type::DSON_INVALID_UNICODE_SURROGATE;
+            else {
+                escape_ = ESCAPE_HEX;
+                hex_left_ = 4;
+                hex_ = 0;
+                low_surrogate_ = true;
+            }
+            break;
+    }
+}
+
+// token is a whole literal or number; a valid value followed by more bytes, e.g. "01" or "truex",
+// is reported like the parser reports a missing separator
+void dson_transcoder::end_scalar(const string_view& token) {
+    dson_validate_context ctx(token);
+    error_type err = ctx.validate();
+    if (err == error_type::DSON_OK && !ctx.is_completed()) err = stack_.empty() ? error_type::DSON_ROOT_NOT_SINGULAR : miss_separator(stack_.back());
+    if (err != error_type::DSON_OK)
+        error_ = err;
+    else
+        end_value();
+}
+
+template <typename Out>
+void dson_transcoder::newline(Out& out) {
+    out.put('\n');
+    out.fill(' ', stack_.size() * indent_);
+}
+
+template <typename Out>
+bool dson_transcoder::begin_value(Out& out, bool key) {
+    if (expect_colon_) {
+        error_ = error_type::DSON_MISS_COLON;
+        return false;
+    }
+    if (expect_key_ && !key) {
+        error_ = error_type::DSON_MISS_KEY;
+        return false;
+    }
+    if (need_separator_) {
+        if (!stack_.empty()) {
+            error_ = miss_separator(stack_.back());
+            return false;
+        }
+        // next top-level value
+        if (indent_ >= 0 || skipped_whitespace_) out.put('\n');
+    }
+    else if (pending_open_ && indent_ >= 0)
+        newline(out);
+    pending_open_ = false;
+    need_separator_ = false;
+    expect_key_ = false;
+    in_key_ = key;
+    seen_value_ = true;
+    return true;
+}
+
+template <typename Out>
+void dson_transcoder::close(char ch, Out& out) {
+    char open = ch == ']' ? '[' : '{';
+    if (stack_.empty()) {
+        error_ = error_type::DSON_ROOT_NOT_SINGULAR;
+        return;
+    }
+    if (expect_colon_) {
+        error_ = error_type::DSON_MISS_COLON;
+        return;
+    }
+    // an empty object, or a key missing after '{' or ','
+    if (expect_key_) {
+        if (!pending_open_ || ch != '}') {
+            error_ = error_type::DSON_MISS_KEY;
+            return;
+        }
+        expect_key_ = false;
+    }
+    if (stack_.back() != open) {
+        error_ = need_separator_ ? miss_separator(stack_.back()) : error_type::DSON_INVALID_VALUE;
+        return;
+    }
+    // a trailing comma
+    if (!pending_open_ && !need_separator_) {
+        error_ = error_type::DSON_INVALID_VALUE;
+        return;
+    }
+    stack_.pop_back();
+    if (pending_open_)
+        pending_open_ = false;
+    else if (indent_ >= 0)
+        newline(out);
+    out.put(ch);
+    end_value();
+}
+
+template <typename Out>
+void dson_transcoder::run(const char* p, const char* end, Out& out) {
+    while (p != end && error_ == error_type::DSON_OK) {
+        if (in_string_) {
+            if (escape_ != ESCAPE_NONE) {
+                escape(*p);
+                if (error_ != error_type::DSON_OK) return;
+                out.put(*p++);
+                continue;
+            }
+            const char* q = find_string_special(p, end);
+            out.write(p, q - p);
+            if (q == end) return;
+            if (static_cast<unsigned char>(*q) < 0x20) {
+                error_ = error_type::DSON_INVALID_STRING_CHAR;
+                return;
+            }
+            out.put(*q);
+            if (*q == '\\')
+                escape_ = ESCAPE_START;
+            else {
+                in_string_ = false;
+                if (in_key_) {
+                    in_key_ = false;
+                    expect_colon_ = true;
+                }
+                else
+                    end_value();
+            }
+            p = q + 1;
+            continue;
+        }
+        if (in_scalar_) {
+            // checked before writing, since in place output may overwrite the token
+            const char* q = find_scalar_end(p, end);
+            if (q == end) {
+                scalar_.append(p, q - p);
+                out.write(p, q - p);
+                return;
+            }
+            if (scalar_.empty())
+                end_scalar(string_view(p, q - p));
+            else {
+                scalar_.append(p, q - p);
+                end_scalar(scalar_);
+                scalar_.clear();
+            }
+            if (error_ != error_type::DSON_OK) return;
+            out.write(p, q - p);
+            in_scalar_ = false;
+            p = q;
+            continue;
+        }
+        char ch = *p;
+        switch (ch) {
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                p = skip_whitespace(p, end);
+                skipped_whitespace_ = true;
+                break;
+            case '[':
+            case '{':
+                if (!begin_value(out)) return;
+                out.put(ch);
+                stack_.push_back(ch);
+                pending_open_ = true;
+                expect_key_ = ch == '{';
+                ++p;
+                break;
+            case ']':
+            case '}':
+                close(ch, out);
+                ++p;
+                break;
+            case ',':
+                if (stack_.empty() || expect_colon_ || expect_key_ || !need_separator_) {
+                    error_ = stack_.empty() ? error_type::DSON_ROOT_NOT_SINGULAR
+                                            : (expect_colon_ ? error_type::DSON_MISS_COLON : (expect_key_ ? error_type::DSON_MISS_KEY : error_type::DSON_INVALID_VALUE));
+                    return;
+                }
+                out.put(',');
+                if (indent_ >= 0) newline(out);
+                need_separator_ = false;
+                expect_key_ = stack_.back() == '{';
+                ++p;
+                break;
+            case ':':
+                if (!expect_colon_) {
+                    error_ = stack_.empty() ? error_type::DSON_ROOT_NOT_SINGULAR
+                                            : (expect_key_ ? error_type::DSON_MISS_KEY : (need_separator_ ? miss_separator(stack_.back()) : error_type::DSON_INVALID_VALUE));
+                    return;
+                }
+                out.put(':');
+                if (indent_ >= 0) out.put(' ');
+                expect_colon_ = false;
+                ++p;
+                break;
+            case '"':
+                if (!begin_value(out, expect_key_)) return;
+                out.put('"');
+                in_string_ = true;
+                ++p;
+                break;
+            default:
+                if (static_cast<unsigned char>(ch) < 0x20) {
+                    error_ = error_type::DSON_INVALID_VALUE;
+                    return;
+                }
+                if (!begin_value(out)) return;
+                in_scalar_ = true;
+        }
+    }
+}
+
+error_type dson_transcoder::feed(const string_view& chunk, string& out) {
+    string_out writer(out);
+    run(chunk.data(), chunk.data() + chunk.size(), writer);
+    return error_;
+}
+
+error_type dson_transcoder::finish() {
+    error_type ret = error_;
+    if (ret == error_type::DSON_OK && in_scalar_) {
+        end_scalar(scalar_);
+        ret = error_;
+    }
+    if (ret == error_type::DSON_OK) {
+        if (in_string_) {
+            if (escape_ == ESCAPE_START)
+                ret = error_type::DSON_INVALID_STRING_ESCAPE;
+            else if (escape_ == ESCAPE_HEX)
+                ret = error_type::DSON_INVALID_UNICODE_HEX;
+            else if (escape_ != ESCAPE_NONE)
+                ret = error_type::DSON_INVALID_UNICODE_SURROGATE;
+            else
+                ret = error_type::DSON_MISS_QUOTATION_MARK;
+        }
+        else if (!stack_.empty())
+            ret = expect_colon_ ? error_type::DSON_MISS_COLON
+                                : (expect_key_ ? error_type::DSON_MISS_KEY : (need_separator_ ? miss_separator(stack_.back()) : error_type::DSON_EXPECT_VALUE));
+        else if (!seen_value_)
+            ret = error_type::DSON_EXPECT_VALUE;
+    }
+    *this = dson_transcoder(indent_);
+    return ret;
+}
+
+pair<size_t, error_type> dson_transcoder::minify_inplace(char* json, size_t size) {
+    assert(json || size == 0);
+    dson_transcoder transcoder;
+    inplace_out writer(json);
+    transcoder.run(json, json + size, writer);
+    return make_pair(static_cast<size_t>(writer.end() - json), transcoder.finish());
+}
+
+}  // namespace dson
+
+pair<string, dson::error_type> dson::minify(const string_view& json) {
+    string out;
+    out.reserve(json.size());
+    dson_transcoder transcoder;
+    transcoder.feed(json, out);
+    error_type err = transcoder.finish();
+    return make_pair(move(out), err);
+}
+
+pair<string, dson::error_type> dson::prettify(const string_view& json, int indent) {
+    string out;
+    out.reserve(json.size() + json.size() / 2);
+    dson_transcoder transcoder(indent < 0 ? 0 : indent);
+    transcoder.feed(json, out);
+    error_type err = transcoder.finish();
+    return make_pair(move(out), err);
+}
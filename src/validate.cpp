@@ -0,0 +1,367 @@
+#include "internal.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+namespace dson {
+
+namespace {
+
+#ifdef DSON_SSSE3
+// Lookup-table UTF-8 validation (Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte")
+constexpr char TOO_SHORT = 1 << 0;
+constexpr char TOO_LONG = 1 << 1;
+constexpr char OVERLONG_3 = 1 << 2;
+constexpr char TOO_LARGE = 1 << 3;
+constexpr char SURROGATE = 1 << 4;
+constexpr char OVERLONG_2 = 1 << 5;
+constexpr char TOO_LARGE_1000 = 1 << 6;
+constexpr char OVERLONG_4 = 1 << 6;
+constexpr char TWO_CONTS = static_cast<char>(1 << 7);
+constexpr char CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+class utf8_checker {
+public:
+    DSON_TARGET("ssse3") void check(__m128i input) {
+        if (_mm_movemask_epi8(input) == 0) {
+            error_ = _mm_or_si128(error_, prev_incomplete_);
+            prev_incomplete_ = _mm_setzero_si128();
+        }
+        else {
+            __m128i prev1 = _mm_alignr_epi8(input, prev_input_, 15);
+            __m128i sc = special_cases(input, prev1);
+            __m128i prev2 = _mm_alignr_epi8(input, prev_input_, 14);
+            __m128i prev3 = _mm_alignr_epi8(input, prev_input_, 13);
+            __m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+            __m128i is_fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+            __m128i must23 = _mm_and_si128(_mm_or_si128(is_third, is_fourth), _mm_set1_epi8(static_cast<char>(0x80)));
+            error_ = _mm_or_si128(error_, _mm_xor_si128(must23, sc));
+            const __m128i max_value = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+            prev_incomplete_ = _mm_subs_epu8(input, max_value);
+        }
+        prev_input_ = input;
+    }
+
+    bool valid() const {
+        __m128i err = _mm_or_si128(error_, prev_incomplete_);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(err, _mm_setzero_si128())) == 0xFFFF;
+    }
+
+private:
+    static __m128i high_nibble(__m128i x) { return _mm_and_si128(_mm_srli_epi16(x, 4), _mm_set1_epi8(0x0F)); }
+
+    DSON_TARGET("ssse3") static __m128i special_cases(__m128i input, __m128i prev1) {
+        const __m128i byte_1_high_table = _mm_setr_epi8(TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+                                                        TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE, TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+        const __m128i byte_1_low_table = _mm_setr_epi8(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY, CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                                       CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                                       CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                                       CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000);
+        const __m128i byte_2_high_table = _mm_setr_epi8(TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+                                                        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4, TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+                                                        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, TOO_SHORT, TOO_SHORT,
+                                                        TOO_SHORT, TOO_SHORT);
+        __m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_table, high_nibble(prev1));
+        __m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, _mm_set1_epi8(0x0F)));
+        __m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_table, high_nibble(input));
+        return _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+    }
+
+private:
+    __m128i error_ = _mm_setzero_si128();
+    __m128i prev_input_ = _mm_setzero_si128();
+    __m128i prev_incomplete_ = _mm_setzero_si128();
+};
+
+DSON_TARGET("ssse3") bool utf8_valid_simd(const char* p, size_t n) {
+    utf8_checker checker;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) checker.check(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)));
+    if (i < n) {
+        char buf[16] = { 0 };
+        memcpy(buf, p + i, n - i);
+        checker.check(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf)));
+    }
+    return checker.valid();
+}
+#endif
+
+// First '"', '\\' or control character in [p, end); high is set if any byte >= 0x80 precedes it
+const char* find_string_special(const char* p, const char* end, bool& high) {
+#ifdef DSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    while (end - p >= 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, backslash)), _mm_cmpeq_epi8(_mm_max_epu8(x, control), control));
+        unsigned int mask = _mm_movemask_epi8(special);
+        unsigned int hi = _mm_movemask_epi8(x);
+        if (mask != 0) {
+            int i = trailing_zeros(mask);
+            if (hi & ((1u << i) - 1)) high = true;
+            return p + i;
+        }
+        if (hi != 0) high = true;
+        p += 16;
+    }
+#endif
+    for (; p != end; ++p) {
+        unsigned char ch = *p;
+        if (ch == '"' || ch == '\\' || ch < 0x20) break;
+        if (ch >= 0x80) high = true;
+    }
+    return p;
+}
+
+}  // namespace
+
+size_t validate_utf8(const char* p, size_t n) {
+#ifdef DSON_SSSE3
+    if (cpu_has_ssse3() && utf8_valid_simd(p, n)) return n;
+#endif
+    const unsigned char* begin = reinterpret_cast<const unsigned char*>(p);
+    const unsigned char* end = begin + n;
+    const unsigned char* cur = begin;
+    while (cur != end) {
+#ifdef DSON_SSE2
+        while (end - cur >= 16 && _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cur))) == 0) cur += 16;
+        if (cur == end) break;
+#endif
+        if (*cur < 0x80) {
+            ++cur;
+            continue;
+        }
+        size_t len = utf8_sequence_length(cur, end);
+        if (len == 0) return cur - begin;
+        cur += len;
+    }
+    return n;
+}
+
+bool number_overflows(const string_view& token) {
+    size_t i = 0, n = token.size();
+    if (token[i] == '-') ++i;
+    size_t int_begin = i;
+    while (i < n && is_digit(token[i])) ++i;
+    size_t int_end = i, frac_begin = i, frac_end = i;
+    if (i < n && token[i] == '.') {
+        frac_begin = ++i;
+        while (i < n && is_digit(token[i])) ++i;
+        frac_end = i;
+    }
+    // without an exponent it takes over 300 digits to overflow
+    if (i == n && n <= 300) return false;
+    long long exp = 0;
+    if (i < n) {
+        bool negative = token[++i] == '-';
+        if (token[i] == '+' || token[i] == '-') ++i;
+        for (; i < n; ++i)
+            if (exp < 1000000000) exp = exp * 10 + (token[i] - '0');
+        if (negative) exp = -exp;
+    }
+    // decimal exponent of the first significant digit
+    long long e10;
+    size_t k = int_begin;
+    while (k < int_end && token[k] == '0') ++k;
+    if (k < int_end)
+        e10 = static_cast<long long>(int_end - k) - 1;
+    else {
+        k = frac_begin;
+        while (k < frac_end && token[k] == '0') ++k;
+        if (k == frac_end) return false;
+        e10 = -static_cast<long long>(k - frac_begin) - 1;
+    }
+    e10 += exp;
+    if (e10 != 308) return e10 > 308;
+    // close to DBL_MAX the rounding depends on every digit, so let strtod see the whole token
+    return fabs(parse_double(token)) == HUGE_VAL;
+}
+
+error_type dson_validate_context::validate_literal(const char* literal, size_t n) {
+    if (view_.size() < n || view_.compare(0, n, literal) != 0) return error_type::DSON_INVALID_VALUE;
+    view_.remove_prefix(n);
+    return error_type::DSON_OK;
+}
+
+error_type dson_validate_context::validate_number() {
+    const char* p = view_.data();
+    const char* end = p + view_.size();
+    const char* q = p;
+    if (*q == '-') ++q;
+    if (q == end) return error_type::DSON_INVALID_VALUE;
+    if (*q == '0')
+        ++q;
+    else {
+        if (!is_digit(*q)) return error_type::DSON_INVALID_VALUE;
+        while (q != end && is_digit(*q)) ++q;
+    }
+    if (q != end && *q == '.') {
+        ++q;
+        if (q == end || !is_digit(*q)) return error_type::DSON_INVALID_VALUE;
+        while (q != end && is_digit(*q)) ++q;
+    }
+    if (q != end && (*q == 'e' || *q == 'E')) {
+        ++q;
+        if (q != end && (*q == '+' || *q == '-')) ++q;
+        if (q == end || !is_digit(*q)) return error_type::DSON_INVALID_VALUE;
+        while (q != end && is_digit(*q)) ++q;
+    }
+    if (number_overflows(string_view(p, q - p))) return error_type::DSON_NUMBER_TOO_BIG;
+    view_.remove_prefix(q - p);
+    return error_type::DSON_OK;
+}
+
+error_type dson_validate_context::validate_string() {
+    const char* p = view_.data() + 1;
+    const char* end = view_.data() + view_.size();
+    auto seek = [this](const char* pos) { view_.remove_prefix(pos - view_.data()); };
+    while (true) {
+        bool high = false;
+        const char* q = find_string_special(p, end, high);
+        if (high) {
+            size_t bad = validate_utf8(p, q - p);
+            if (bad != static_cast<size_t>(q - p)) {
+                seek(p + bad);
+                return error_type::DSON_INVALID_UTF8;
+            }
+        }
+        if (q == end) {
+            seek(end);
+            return error_type::DSON_MISS_QUOTATION_MARK;
+        }
+        if (*q == '"') {
+            seek(q + 1);
+            return error_type::DSON_OK;
+        }
+        if (*q != '\\') {
+            seek(q);
+            return error_type::DSON_INVALID_STRING_CHAR;
+        }
+        const char* escape = q++;
+        if (q == end) {
+            seek(escape);
+            return error_type::DSON_INVALID_STRING_ESCAPE;
+        }
+        switch (*q) {
+            case '\"':
+            case '\\':
+            case '/':
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't': p = q + 1; break;
+            case 'u': {
+                unsigned int u;
+                if (!parse_hex4(q + 1, end, u)) {
+                    seek(escape);
+                    return error_type::DSON_INVALID_UNICODE_HEX;
+                }
+                q += 5;
+                if (u >= 0xD800 && u <= 0xDBFF) {
+                    if (end - q < 2 || q[0] != '\\' || q[1] != 'u') {
+                        seek(escape);
+                        return error_type::DSON_INVALID_UNICODE_SURROGATE;
+                    }
+                    unsigned int un;
+                    if (!parse_hex4(q + 2, end, un)) {
+                        seek(q);
+                        return error_type::DSON_INVALID_UNICODE_HEX;
+                    }
+                    if (un < 0xDC00 || un > 0xDFFF) {
+                        seek(escape);
+                        return error_type::DSON_INVALID_UNICODE_SURROGATE;
+                    }
+                    q += 6;
+                }
+                p = q;
+            } break;
+            default: seek(escape); return error_type::DSON_INVALID_STRING_ESCAPE;
+        }
+    }
+}
+
+error_type dson_validate_context::validate_array() {
+    view_.remove_prefix(1);
+    skip_whitespace();
+    if (!view_.empty() && view_.front() == ']') {
+        view_.remove_prefix(1);
+        return error_type::DSON_OK;
+    }
+    while (true) {
+        error_type err = validate();
+        if (err != error_type::DSON_OK) return err;
+        skip_whitespace();
+        if (!view_.empty() && view_.front() == ',') {
+            view_.remove_prefix(1);
+            skip_whitespace();
+        }
+        else if (!view_.empty() && view_.front() == ']') {
+            view_.remove_prefix(1);
+            return error_type::DSON_OK;
+        }
+        else
+            return error_type::DSON_MISS_COMMA_OR_SQUARE_BRACKET;
+    }
+}
+
+error_type dson_validate_context::validate_object() {
+    view_.remove_prefix(1);
+    skip_whitespace();
+    if (!view_.empty() && view_.front() == '}') {
+        view_.remove_prefix(1);
+        return error_type::DSON_OK;
+    }
+    while (true) {
+        if (view_.empty() || view_.front() != '"') return error_type::DSON_MISS_KEY;
+        error_type err = validate_string();
+        if (err != error_type::DSON_OK) return err;
+        skip_whitespace();
+        if (view_.empty() || view_.front() != ':') return error_type::DSON_MISS_COLON;
+        view_.remove_prefix(1);
+        skip_whitespace();
+        err = validate();
+        if (err != error_type::DSON_OK) return err;
+        skip_whitespace();
+        if (!view_.empty() && view_.front() == ',') {
+            view_.remove_prefix(1);
+            skip_whitespace();
+        }
+        else if (!view_.empty() && view_.front() == '}') {
+            view_.remove_prefix(1);
+            return error_type::DSON_OK;
+        }
+        else
+            return error_type::DSON_MISS_COMMA_OR_CURLY_BRACKET;
+    }
+}
+
+error_type dson_validate_context::validate() {
+    if (view_.empty()) return error_type::DSON_EXPECT_VALUE;
+    switch (view_.front()) {
+        case 'n': return validate_literal("null", 4);
+        case 'f': return validate_literal("false", 5);
+        case 't': return validate_literal("true", 4);
+        case '"': return validate_string();
+        case '[': return validate_array();
+        case '{': return validate_object();
+        default: return validate_number();
+    }
+}
+
+}  // namespace dson
+
+pair<dson::error_type, size_t> dson::validate(const string_view& json) {
+    dson_validate_context ctx(json);
+    ctx.skip_whitespace();
+    error_type ret = ctx.validate();
+    if (ret == error_type::DSON_OK) {
+        ctx.skip_whitespace();
+        if (!ctx.is_completed()) ret = error_type::DSON_ROOT_NOT_SINGULAR;
+    }
+    return make_pair(ret, ctx.offset());
+}
@@ -7,6 +7,9 @@
 
 #include <gtest/gtest.h>
 
+#include <random>
+#include <thread>
+
 using namespace dson;
 using namespace std;
 
@@ -94,6 +97,8 @@ TEST(dson, parse_number) {
     TEST_PARSE_NUMBER(0.0, "-0");
     TEST_PARSE_NUMBER(0.0, "-0.0");
     TEST_PARSE_NUMBER(2.0, "2");
+    TEST_PARSE_NUMBER(10.0, "10");
+    TEST_PARSE_NUMBER(-1024.0, "-1024");
     TEST_PARSE_NUMBER(-2.0, "-2");
     TEST_PARSE_NUMBER(4.5, "4.5");
     TEST_PARSE_NUMBER(-2.5, "-2.5");
@@ -324,6 +329,653 @@ TEST(dson, parse_object) {
     EXPECT_EQ(get<double>(p3->option_value().value()), 3);
 }
 
+#define TEST_VALIDATE(expect, json)                  \
+    do {                                             \
+        EXPECT_EQ(validate(json).first, expect);     \
+        EXPECT_EQ(doc.parse(json), expect) << json;  \
+        EXPECT_EQ(lazy.parse(json), expect) << json; \
+    } while (0)
+
+TEST(dson, validate) {
+    dson_parser doc;
+    dson_parser lazy;
+    lazy.set_lazy_number(true);
+    TEST_VALIDATE(error_type::DSON_OK, "null");
+    TEST_VALIDATE(error_type::DSON_OK, " [ 1, 2.5e10, -0, \"a\\u20AC\", { \"k\" : [ true, false ] } ] ");
+    TEST_VALIDATE(error_type::DSON_OK, "1.7976931348623157e308");
+    TEST_VALIDATE(error_type::DSON_EXPECT_VALUE, "  ");
+    TEST_VALIDATE(error_type::DSON_EXPECT_VALUE, "[");
+    TEST_VALIDATE(error_type::DSON_INVALID_VALUE, "nul");
+    TEST_VALIDATE(error_type::DSON_INVALID_VALUE, "[1,]");
+    TEST_VALIDATE(error_type::DSON_INVALID_VALUE, "3.");
+    TEST_VALIDATE(error_type::DSON_ROOT_NOT_SINGULAR, "0x1");
+    TEST_VALIDATE(error_type::DSON_NUMBER_TOO_BIG, "-2E400");
+    TEST_VALIDATE(error_type::DSON_NUMBER_TOO_BIG, "1.8e308");
+    TEST_VALIDATE(error_type::DSON_NUMBER_TOO_BIG, "0.00018e312");
+    // 2^1024 - 2^970 rounds up to infinity, one less rounds down to DBL_MAX
+    TEST_VALIDATE(error_type::DSON_NUMBER_TOO_BIG, "179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497792");
+    TEST_VALIDATE(error_type::DSON_OK, "179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497791");
+    TEST_VALIDATE(error_type::DSON_NUMBER_TOO_BIG, "-179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497792.0e0");
+    TEST_VALIDATE(error_type::DSON_MISS_QUOTATION_MARK, "\"abc");
+    TEST_VALIDATE(error_type::DSON_INVALID_STRING_ESCAPE, "\"\\x\"");
+    TEST_VALIDATE(error_type::DSON_INVALID_STRING_CHAR, "\"tab\there\"");
+    TEST_VALIDATE(error_type::DSON_INVALID_UNICODE_HEX, "\"\\u12G4\"");
+    TEST_VALIDATE(error_type::DSON_INVALID_UNICODE_SURROGATE, "\"\\uD800\\u0041\"");
+    TEST_VALIDATE(error_type::DSON_MISS_COMMA_OR_SQUARE_BRACKET, "[1 2]");
+    TEST_VALIDATE(error_type::DSON_MISS_KEY, "{1:2}");
+    TEST_VALIDATE(error_type::DSON_MISS_COLON, "{\"a\" 2}");
+    TEST_VALIDATE(error_type::DSON_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":2 \"b\":3}");
+}
+
+TEST(dson, validate_offset) {
+    EXPECT_EQ(validate(" true ").second, 6);
+    EXPECT_EQ(validate("[1, 2, x]").second, 7);
+    EXPECT_EQ(validate("{\"a\": [1 2]}").second, 9);
+    EXPECT_EQ(validate("\"abc").second, 4);
+}
+
+TEST(dson, validate_utf8) {
+    EXPECT_EQ(validate("\"\xE4\xBD\xA0\xE5\xA5\xBD, \xF0\x9D\x84\x9E\"").first, error_type::DSON_OK);
+    EXPECT_EQ(validate("\"\xC0\xAF\"").first, error_type::DSON_INVALID_UTF8);
+    EXPECT_EQ(validate("\"\xED\xA0\x80\"").first, error_type::DSON_INVALID_UTF8);
+    EXPECT_EQ(validate("\"\xF4\x90\x80\x80\"").first, error_type::DSON_INVALID_UTF8);
+    EXPECT_EQ(validate("\"\xE4\xBD\"").first, error_type::DSON_INVALID_UTF8);
+    EXPECT_EQ(validate("\"\x80\"").first, error_type::DSON_INVALID_UTF8);
+
+    // long strings go through the vectorized paths, the error must be reported at the offending byte
+    for (size_t pos = 0; pos < 70; ++pos) {
+        string json = "\"" + string(80, 'a') + "\"";
+        json.replace(1 + pos, 3, "\xE2\x82\xAC");
+        EXPECT_EQ(validate(json).first, error_type::DSON_OK);
+        json[1 + pos + 2] = 'x';
+        auto [err, offset] = validate(json);
+        EXPECT_EQ(err, error_type::DSON_INVALID_UTF8);
+        EXPECT_EQ(offset, 1 + pos);
+    }
+}
+
+static shared_ptr<dson_value> parse_tree(const string_view& json) {
+    dson_parser parser;
+    EXPECT_EQ(parser.parse(json), error_type::DSON_OK);
+    return parser.root();
+}
+
+static double number_at(const dson_document& doc, const string_view& path) {
+    auto v = doc.find(path);
+    EXPECT_TRUE(v);
+    return v ? get<double>(v->option_value().value()) : 0;
+}
+
+TEST(dson, document_find) {
+    dson_document doc(parse_tree("{\"a\": [1, {\"b/c\": 2, \"d~e\": 3}], \"\": 4}"));
+    EXPECT_EQ(doc.find(""), doc.root());
+    EXPECT_EQ(number_at(doc, "/a/0"), 1);
+    EXPECT_EQ(number_at(doc, "/a/1/b~1c"), 2);
+    EXPECT_EQ(number_at(doc, "/a/1/d~0e"), 3);
+    EXPECT_EQ(number_at(doc, "/"), 4);
+    EXPECT_FALSE(doc.find("a"));
+    EXPECT_FALSE(doc.find("/a/2"));
+    EXPECT_FALSE(doc.find("/a/01"));
+    EXPECT_FALSE(doc.find("/a/0/x"));
+    EXPECT_FALSE(doc.find("/a/1/b~2c"));
+}
+
+TEST(dson, document_edit) {
+    dson_document v1(parse_tree("{\"config\": {\"port\": 80, \"hosts\": [\"a\", \"b\"]}, \"big\": [1, 2, 3]}"));
+    auto value = parse_tree("8080");
+
+    auto [v2, err] = v1.set("/config/port", value);
+    EXPECT_EQ(err, error_type::DSON_OK);
+    EXPECT_EQ(number_at(v1, "/config/port"), 80);
+    EXPECT_EQ(number_at(v2, "/config/port"), 8080);
+    // only the path to the change is copied
+    EXPECT_NE(v1.root(), v2.root());
+    EXPECT_NE(v1.find("/config"), v2.find("/config"));
+    EXPECT_EQ(v1.find("/config/hosts"), v2.find("/config/hosts"));
+    EXPECT_EQ(v1.find("/big"), v2.find("/big"));
+
+    auto [v3, e3] = v2.insert("/config/hosts/1", parse_tree("\"c\""));
+    EXPECT_EQ(e3, error_type::DSON_OK);
+    auto [v4, e4] = v3.insert("/config/hosts/-", parse_tree("\"d\""));
+    EXPECT_EQ(e4, error_type::DSON_OK);
+    auto hosts = get<vector<shared_ptr<dson_value>>>(v4.find("/config/hosts")->option_value().value());
+    ASSERT_EQ(hosts.size(), 4);
+    EXPECT_EQ(get<string>(hosts[1]->option_value().value()), "c");
+    EXPECT_EQ(get<string>(hosts[3]->option_value().value()), "d");
+    EXPECT_EQ(get<vector<shared_ptr<dson_value>>>(v2.find("/config/hosts")->option_value().value()).size(), 2);
+
+    auto [v5, e5] = v4.erase("/big/0");
+    EXPECT_EQ(e5, error_type::DSON_OK);
+    EXPECT_EQ(number_at(v5, "/big/0"), 2);
+    EXPECT_EQ(number_at(v4, "/big/0"), 1);
+    auto [v6, e6] = v5.erase("/config");
+    EXPECT_EQ(e6, error_type::DSON_OK);
+    EXPECT_FALSE(v6.find("/config"));
+    EXPECT_EQ(v6.find("/big"), v5.find("/big"));
+
+    auto [v7, e7] = v1.set("", value);
+    EXPECT_EQ(e7, error_type::DSON_OK);
+    EXPECT_EQ(v7.root(), value);
+}
+
+TEST(dson, document_edit_error) {
+    dson_document doc(parse_tree("{\"arr\": [1, 2], \"num\": 1}"));
+    auto value = parse_tree("null");
+    EXPECT_EQ(doc.set("arr", value).second, error_type::DSON_INVALID_POINTER);
+    EXPECT_EQ(doc.set("/arr/x", value).second, error_type::DSON_INVALID_POINTER);
+    EXPECT_EQ(doc.set("/arr/2", value).second, error_type::DSON_POINTER_NOT_FOUND);
+    EXPECT_EQ(doc.set("/arr/-", value).second, error_type::DSON_POINTER_NOT_FOUND);
+    EXPECT_EQ(doc.insert("/arr/3", value).second, error_type::DSON_POINTER_NOT_FOUND);
+    EXPECT_EQ(doc.insert("/missing/a", value).second, error_type::DSON_POINTER_NOT_FOUND);
+    EXPECT_EQ(doc.insert("/num/a", value).second, error_type::DSON_POINTER_NOT_FOUND);
+    EXPECT_EQ(doc.erase("/missing").second, error_type::DSON_POINTER_NOT_FOUND);
+    EXPECT_EQ(doc.erase("").second, error_type::DSON_INVALID_POINTER);
+    auto [same, err] = doc.erase("/arr/5");
+    EXPECT_EQ(err, error_type::DSON_POINTER_NOT_FOUND);
+    EXPECT_EQ(same.root(), doc.root());
+}
+
+TEST(dson, value_equal_hash) {
+    auto a = parse_tree("{\"a\": [1, 2, {\"x\": null}], \"b\": \"s\", \"c\": -0}");
+    auto b = parse_tree("{\"c\": 0, \"b\": \"s\", \"a\": [1, 2, {\"x\": null}]}");
+    EXPECT_TRUE(*a == *b);
+    EXPECT_EQ(a->hash(), b->hash());
+    EXPECT_TRUE(*parse_tree("[1, 2]") != *parse_tree("[2, 1]"));
+    EXPECT_TRUE(*parse_tree("{\"a\": 1}") != *parse_tree("{\"a\": true}"));
+    EXPECT_TRUE(*parse_tree("[]") != *parse_tree("{}"));
+    EXPECT_NE(parse_tree("[1, 2]")->hash(), parse_tree("[2, 1]")->hash());
+}
+
+#define TEST_PATCH(expect, json, patch, result)                           \
+    do {                                                                  \
+        auto root = parse_tree(json);                                     \
+        EXPECT_EQ(apply_patch(root, parse_tree(patch)), expect) << patch; \
+        EXPECT_TRUE(*root == *parse_tree(result)) << patch;               \
+    } while (0)
+
+TEST(dson, apply_patch) {
+    TEST_PATCH(error_type::DSON_OK, "{\"foo\": \"bar\"}", "[{\"op\": \"add\", \"path\": \"/baz\", \"value\": \"qux\"}]", "{\"foo\": \"bar\", \"baz\": \"qux\"}");
+    TEST_PATCH(error_type::DSON_OK, "{\"foo\": [\"bar\", \"baz\"]}", "[{\"op\": \"add\", \"path\": \"/foo/1\", \"value\": \"qux\"}]", "{\"foo\": [\"bar\", \"qux\", \"baz\"]}");
+    TEST_PATCH(error_type::DSON_OK, "{\"foo\": [1]}", "[{\"op\": \"add\", \"path\": \"/foo/-\", \"value\": [2]}]", "{\"foo\": [1, [2]]}");
+    TEST_PATCH(error_type::DSON_OK, "{\"foo\": [1, 2, 3]}", "[{\"op\": \"remove\", \"path\": \"/foo/1\"}]", "{\"foo\": [1, 3]}");
+    TEST_PATCH(error_type::DSON_OK, "{\"foo\": 1, \"bar\": 2}", "[{\"op\": \"replace\", \"path\": \"/foo\", \"value\": {\"x\": 3}}]", "{\"foo\": {\"x\": 3}, \"bar\": 2}");
+    TEST_PATCH(error_type::DSON_OK, "{\"foo\": {\"bar\": 1}, \"qux\": {}}", "[{\"op\": \"move\", \"from\": \"/foo/bar\", \"path\": \"/qux/thud\"}]", "{\"foo\": {}, \"qux\": {\"thud\": 1}}");
+    TEST_PATCH(error_type::DSON_OK, "[1, 2, 3, 4]", "[{\"op\": \"move\", \"from\": \"/1\", \"path\": \"/3\"}]", "[1, 3, 4, 2]");
+    TEST_PATCH(error_type::DSON_OK, "{\"a\": [1]}", "[{\"op\": \"copy\", \"from\": \"/a\", \"path\": \"/b\"}, {\"op\": \"add\", \"path\": \"/b/-\", \"value\": 2}]",
+               "{\"a\": [1], \"b\": [1, 2]}");
+    TEST_PATCH(error_type::DSON_OK, "{\"a\": [1, {\"b\": \"c\"}]}", "[{\"op\": \"test\", \"path\": \"/a\", \"value\": [1, {\"b\": \"c\"}]}]", "{\"a\": [1, {\"b\": \"c\"}]}");
+    TEST_PATCH(error_type::DSON_OK, "{\"a\": 1}", "[{\"op\": \"replace\", \"path\": \"\", \"value\": [true]}]", "[true]");
+
+    // failures leave the document untouched
+    const char* doc = "{\"a\": [1, 2], \"b\": {\"c\": 3}}";
+    TEST_PATCH(error_type::DSON_PATCH_TEST_FAILED, doc, "[{\"op\": \"remove\", \"path\": \"/a/0\"}, {\"op\": \"test\", \"path\": \"/b/c\", \"value\": 4}]", doc);
+    TEST_PATCH(error_type::DSON_POINTER_NOT_FOUND, doc,
+               "[{\"op\": \"replace\", \"path\": \"\", \"value\": 1}, {\"op\": \"add\", \"path\": \"/x\", \"value\": 1}]", doc);
+    TEST_PATCH(error_type::DSON_POINTER_NOT_FOUND, doc,
+               "[{\"op\": \"move\", \"from\": \"/b/c\", \"path\": \"/a/1\"}, {\"op\": \"add\", \"path\": \"/b/d\", \"value\": 5}, "
+               "{\"op\": \"remove\", \"path\": \"/a/9\"}]",
+               doc);
+    TEST_PATCH(error_type::DSON_INVALID_PATCH, doc, "[{\"op\": \"move\", \"from\": \"/b\", \"path\": \"/b/x\"}]", doc);
+    // the moved node is still needed by the undo of its removal
+    TEST_PATCH(error_type::DSON_POINTER_NOT_FOUND, doc, "[{\"op\": \"move\", \"from\": \"/a\", \"path\": \"\"}, {\"op\": \"test\", \"path\": \"/nope\", \"value\": 1}]", doc);
+    TEST_PATCH(error_type::DSON_POINTER_NOT_FOUND, doc,
+               "[{\"op\": \"add\", \"path\": \"/a/0\", \"value\": 0}, {\"op\": \"move\", \"from\": \"/a\", \"path\": \"\"}, "
+               "{\"op\": \"add\", \"path\": \"/0\", \"value\": 9}, {\"op\": \"test\", \"path\": \"/nope\", \"value\": 1}]",
+               doc);
+    TEST_PATCH(error_type::DSON_INVALID_PATCH, doc, "[{\"op\": \"add\", \"path\": \"/x\"}]", doc);
+    TEST_PATCH(error_type::DSON_INVALID_PATCH, doc, "[{\"op\": \"frob\", \"path\": \"/x\"}]", doc);
+    TEST_PATCH(error_type::DSON_INVALID_PATCH, doc, "{\"op\": \"remove\", \"path\": \"/a\"}", doc);
+    TEST_PATCH(error_type::DSON_INVALID_POINTER, doc, "[{\"op\": \"remove\", \"path\": \"a\"}]", doc);
+}
+
+// Every path in v, parents before children
+static void collect_paths(const dson_value& v, const string& path, vector<string>& paths) {
+    paths.push_back(path);
+    if (v.type() == dson_type::DSON_ARRAY) {
+        const auto& arr = get<vector<shared_ptr<dson_value>>>(v.option_value().value());
+        for (size_t i = 0; i < arr.size(); ++i) collect_paths(*arr[i], path + "/" + to_string(i), paths);
+    }
+    else if (v.type() == dson_type::DSON_OBJECT)
+        for (const auto& kv : get<unordered_map<string, shared_ptr<dson_value>>>(v.option_value().value())) collect_paths(*kv.second, path + "/" + kv.first, paths);
+}
+
+TEST(dson, apply_patch_rollback_random) {
+    const char* doc = "{\"a\": [1, [2, 3], {\"x\": 4}], \"b\": {\"c\": [5], \"d\": {\"e\": 6}}, \"f\": 7}";
+    const char* values[] = { "0", "[8, 9]", "{\"y\": [10]}", "\"s\"" };
+    const char* names[] = { "add", "remove", "replace", "move", "copy" };
+    vector<string> paths;
+    collect_paths(*parse_tree(doc), "", paths);
+    paths.push_back("/a/-");
+    paths.push_back("/b/new");
+    mt19937 rng(42);
+    for (int round = 0; round < 2000; ++round) {
+        string patch = "[";
+        int count = 1 + rng() % 5;
+        for (int i = 0; i < count; ++i) {
+            const char* name = names[rng() % 5];
+            patch += string("{\"op\": \"") + name + "\", \"path\": \"" + paths[rng() % paths.size()] + "\"";
+            if (name == names[3] || name == names[4]) patch += ", \"from\": \"" + paths[rng() % paths.size()] + "\"";
+            if (name == names[0] || name == names[2]) patch += string(", \"value\": ") + values[rng() % 4];
+            patch += "}, ";
+        }
+        // whatever came before, this fails and everything must be undone
+        patch += "{\"op\": \"test\", \"path\": \"/nope\", \"value\": 1}]";
+        auto root = parse_tree(doc);
+        EXPECT_NE(apply_patch(root, parse_tree(patch)), error_type::DSON_OK) << patch;
+        EXPECT_TRUE(*root == *parse_tree(doc)) << patch;
+    }
+}
+
+TEST(dson, apply_merge_patch) {
+    auto root = parse_tree("{\"title\": \"Goodbye!\", \"author\": {\"givenName\": \"John\", \"familyName\": \"Doe\"}, \"tags\": [\"example\", \"sample\"], \"content\": \"text\"}");
+    apply_merge_patch(root, parse_tree("{\"title\": \"Hello!\", \"phoneNumber\": \"+01-123-456-7890\", \"author\": {\"familyName\": null}, \"tags\": [\"example\"]}"));
+    EXPECT_TRUE(*root == *parse_tree("{\"title\": \"Hello!\", \"author\": {\"givenName\": \"John\"}, \"tags\": [\"example\"], \"content\": \"text\", "
+                                     "\"phoneNumber\": \"+01-123-456-7890\"}"));
+
+    root = parse_tree("[1, 2]");
+    apply_merge_patch(root, parse_tree("{\"a\": {\"b\": null, \"c\": {\"d\": 1}}}"));
+    EXPECT_TRUE(*root == *parse_tree("{\"a\": {\"c\": {\"d\": 1}}}"));
+    apply_merge_patch(root, parse_tree("\"str\""));
+    EXPECT_TRUE(*root == *parse_tree("\"str\""));
+}
+
+#define TEST_DIFF(from, to, ops)                                                                         \
+    do {                                                                                                 \
+        auto a = parse_tree(from);                                                                       \
+        auto b = parse_tree(to);                                                                         \
+        auto patch = diff(a, b);                                                                         \
+        EXPECT_EQ(get<vector<shared_ptr<dson_value>>>(patch->option_value().value()).size(), ops) << to; \
+        EXPECT_EQ(apply_patch(a, patch), error_type::DSON_OK);                                           \
+        EXPECT_TRUE(*a == *b) << to;                                                                     \
+    } while (0)
+
+TEST(dson, diff) {
+    TEST_DIFF("{\"a\": 1}", "{\"a\": 1}", 0);
+    TEST_DIFF("{\"a\": 1, \"b\": {\"c\": [1, 2, 3], \"d\": \"x\"}}", "{\"a\": 1, \"b\": {\"c\": [1, 2, 3], \"d\": \"y\"}}", 1);
+    TEST_DIFF("{\"a\": 1, \"b\": 2}", "{\"b\": 2, \"c\": 3}", 2);
+    TEST_DIFF("[1, 2, 3, 4, 5]", "[1, 2, 9, 4, 5]", 1);
+    TEST_DIFF("[1, 2, 3, 4, 5]", "[0, 1, 2, 4, 5, 6]", 3);
+    TEST_DIFF("[1, 2, 3, 4, 5]", "[5, 4, 3, 2, 1]", 4);
+    TEST_DIFF("[{\"id\": 1, \"v\": [1]}, {\"id\": 2}]", "[{\"id\": 1, \"v\": [1, 2]}, {\"id\": 2}]", 1);
+    TEST_DIFF("[[1, 2], 3]", "[3]", 1);
+    TEST_DIFF("[]", "[1, [2], {\"3\": 4}]", 3);
+    TEST_DIFF("{\"a/b\": 1, \"c~d\": [1]}", "{\"a/b\": 2, \"c~d\": []}", 2);
+    TEST_DIFF("{\"a\": 1}", "[1]", 1);
+
+    // many equal large elements: each pair is decided by class, not by a deep compare
+    string big = "{\"k\": [";
+    for (int i = 0; i < 500; ++i) big += (i ? ", " : "") + to_string(i);
+    big += "]}";
+    string from, to;
+    for (int i = 0; i < 300; ++i) {
+        from += big + ", ";
+        to += ", " + (i == 150 ? string("2") : big);
+    }
+    TEST_DIFF("[" + from + "1]", "[1" + to + "]", 3);
+}
+
+TEST(dson, extract_columns) {
+    const string json =
+        "{\"meta\": {\"n\": 4}, \"rows\": ["
+        "{\"id\": 1, \"name\": \"a\\u00e9\", \"ok\": true, \"tags\": [1]},"
+        "{\"id\": 2, \"score\": null, \"ok\": false, \"name\": null},"
+        "{\"ok\": true, \"id\": 3, \"score\": 9.5, \"name\": \"c\\n\", \"name\": \"d\"},"
+        "{\"id\": 4.5, \"score\": 7}"
+        "]}";
+    dson_table table;
+    auto [err, offset] = extract_columns(json, "/rows", table);
+    EXPECT_EQ(err, error_type::DSON_OK);
+    EXPECT_EQ(offset, json.size());
+    EXPECT_EQ(table.rows, 4u);
+    ASSERT_EQ(table.columns.size(), 4u);
+
+    // int64 widened to double at 4.5
+    const dson_column& id = table.columns[0];
+    EXPECT_EQ(id.name, "id");
+    EXPECT_EQ(id.type, dson_column_type::DSON_DOUBLE);
+    EXPECT_EQ(id.doubles, vector<double>({ 1, 2, 3, 4.5 }));
+
+    const dson_column& name = table.columns[1];
+    EXPECT_EQ(name.type, dson_column_type::DSON_STRING);
+    EXPECT_EQ(name.string_at(0), "a\xC3\xA9");
+    EXPECT_FALSE(name.is_valid(1));
+    EXPECT_EQ(name.string_at(1), "");
+    EXPECT_EQ(name.string_at(2), "d");
+    EXPECT_FALSE(name.is_valid(3));
+    EXPECT_EQ(name.offsets.size(), 5u);
+
+    const dson_column& ok = table.columns[2];
+    EXPECT_EQ(ok.type, dson_column_type::DSON_BOOL);
+    EXPECT_EQ(ok.int64s, vector<int64_t>({ 1, 0, 1, 0 }));
+    EXPECT_FALSE(ok.is_valid(3));
+
+    // created at the first non-null value, earlier rows are null
+    const dson_column& score = table.columns[3];
+    EXPECT_EQ(score.name, "score");
+    EXPECT_EQ(score.type, dson_column_type::DSON_DOUBLE);
+    EXPECT_FALSE(score.is_valid(0));
+    EXPECT_FALSE(score.is_valid(1));
+    EXPECT_TRUE(score.is_valid(2));
+    EXPECT_EQ(score.doubles, vector<double>({ 0, 0, 9.5, 7 }));
+}
+
+TEST(dson, extract_columns_schema) {
+    dson_table table;
+    table.columns.push_back({ "id", dson_column_type::DSON_INT64 });
+    table.columns.push_back({ "name", dson_column_type::DSON_STRING });
+    EXPECT_EQ(extract_columns("[{\"name\": \"x\", \"id\": 7, \"other\": {}}, {}]", "", table).first, error_type::DSON_OK);
+    EXPECT_EQ(table.rows, 2u);
+    ASSERT_EQ(table.columns.size(), 2u);
+    EXPECT_EQ(table.columns[0].int64s, vector<int64_t>({ 7, 0 }));
+    EXPECT_TRUE(table.columns[0].is_valid(0));
+    EXPECT_FALSE(table.columns[0].is_valid(1));
+    EXPECT_EQ(table.columns[1].string_at(0), "x");
+
+    const string bad = "[{\"id\": 1.5}]";
+    auto [err, offset] = extract_columns(bad, "", table);
+    EXPECT_EQ(err, error_type::DSON_SCHEMA_MISMATCH);
+    EXPECT_EQ(offset, bad.find("1.5"));
+    EXPECT_EQ(extract_columns("[{\"id\": \"1\"}]", "", table).first, error_type::DSON_SCHEMA_MISMATCH);
+    EXPECT_EQ(extract_columns("[1]", "", table).first, error_type::DSON_SCHEMA_MISMATCH);
+    EXPECT_EQ(extract_columns("{\"a\": {}}", "/a", table).first, error_type::DSON_SCHEMA_MISMATCH);
+    EXPECT_EQ(extract_columns("{\"a\": []}", "/b", table).first, error_type::DSON_POINTER_NOT_FOUND);
+    EXPECT_EQ(extract_columns("[[], [{}]]", "/1", table).first, error_type::DSON_OK);
+    EXPECT_EQ(table.rows, 1u);
+    EXPECT_EQ(extract_columns("[]", "a", table).first, error_type::DSON_INVALID_POINTER);
+    // the whole text is validated
+    EXPECT_EQ(extract_columns("{\"a\": [], \"b\": [tru]}", "/a", table).first, error_type::DSON_INVALID_VALUE);
+    EXPECT_EQ(extract_columns("[{\"id\": 1} 2]", "", table).first, error_type::DSON_MISS_COMMA_OR_SQUARE_BRACKET);
+    EXPECT_EQ(extract_columns("[{}] x", "", table).first, error_type::DSON_ROOT_NOT_SINGULAR);
+}
+
+TEST(dson, stringify) {
+    dson_generator gen;
+    EXPECT_EQ(gen.stringify_raw(parse_tree("[null, false, true, 1.5, \"a\\n\\u0001\", [], {}]")), "[null,false,true,1.5,\"a\\n\\u0001\",[],{}]");
+    EXPECT_EQ(gen.stringify_raw(parse_tree("{\"a\": [1, {\"b\": \"c\"}]}")), "{\"a\":[1,{\"b\":\"c\"}]}");
+}
+
+static const dson_number& lazy_number_at(const shared_ptr<dson_value>& arr, size_t i) {
+    const auto& v = get<vector<shared_ptr<dson_value>>>(arr->option_value().value())[i];
+    EXPECT_EQ(v->type(), dson_type::DSON_NUMBER);
+    return get<dson_number>(v->option_value().value());
+}
+
+TEST(dson, parse_lazy_number) {
+    // the text must outlive the tree
+    const string json = "[12345678901234567890, -0.10, 1.50e2, 25E-3, -3.000, 9223372036854775807, 0, 1e-400]";
+    dson_parser parser;
+    parser.set_lazy_number(true);
+    EXPECT_EQ(parser.parse(json), error_type::DSON_OK);
+    auto root = parser.root();
+
+    const auto& big = lazy_number_at(root, 0);
+    EXPECT_EQ(big.raw(), "12345678901234567890");
+    EXPECT_TRUE(big.is_integer());
+    EXPECT_FALSE(big.as_int64());
+    EXPECT_DOUBLE_EQ(big.as_double(), 12345678901234567890.0);
+
+    const auto& frac = lazy_number_at(root, 1);
+    EXPECT_TRUE(frac.is_negative());
+    EXPECT_TRUE(frac.has_fraction());
+    EXPECT_FALSE(frac.has_exponent());
+    EXPECT_DOUBLE_EQ(frac.as_double(), -0.1);
+    EXPECT_FALSE(frac.as_int64());
+    EXPECT_EQ(frac.as_decimal_string(), "-0.10");
+    EXPECT_EQ(&frac.as_decimal_string(), &frac.as_decimal_string());
+    dson_number frac_copy(frac);
+    EXPECT_EQ(frac_copy.as_decimal_string(), "-0.10");
+    EXPECT_NE(&frac_copy.as_decimal_string(), &frac.as_decimal_string());
+
+    EXPECT_EQ(lazy_number_at(root, 2).as_decimal_string(), "150");
+    EXPECT_EQ(lazy_number_at(root, 2).as_int64(), 150);
+    EXPECT_EQ(lazy_number_at(root, 3).as_decimal_string(), "0.025");
+    EXPECT_FALSE(lazy_number_at(root, 3).as_int64());
+    EXPECT_EQ(lazy_number_at(root, 4).as_int64(), -3);
+    EXPECT_EQ(lazy_number_at(root, 5).as_int64(), INT64_MAX);
+    EXPECT_EQ(lazy_number_at(root, 6).as_int64(), 0);
+    EXPECT_EQ(lazy_number_at(root, 7).as_decimal_string(), "0." + string(399, '0') + "1");
+
+    // numbers keep their text through the generator
+    dson_generator gen;
+    EXPECT_EQ(gen.stringify_raw(root), "[12345678901234567890,-0.10,1.50e2,25E-3,-3.000,9223372036854775807,0,1e-400]");
+
+    // the cached conversions travel with copies
+    dson_value copy(*root);
+    EXPECT_TRUE(copy == *root);
+    EXPECT_EQ(copy.hash(), root->hash());
+
+    EXPECT_EQ(parser.parse("[1, 1e400]"), error_type::DSON_NUMBER_TOO_BIG);
+    EXPECT_EQ(parser.parse("-1" + string(400, '0')), error_type::DSON_NUMBER_TOO_BIG);
+    EXPECT_EQ(parser.parse("[1.]"), error_type::DSON_INVALID_VALUE);
+}
+
+TEST(dson, lazy_number_equal) {
+    // the literals outlive the trees, as lazy numbers require
+    auto lazy_tree = [](const char* json) {
+        dson_parser lazy;
+        lazy.set_lazy_number(true);
+        EXPECT_EQ(lazy.parse(json), error_type::DSON_OK);
+        return lazy.root();
+    };
+    // numbers compare by exact value whether lazy or not, so equality stays transitive
+    auto a = lazy_tree("[1.0, 9007199254740992, 1.50, -0]");
+    auto b = parse_tree("[1, 9007199254740993, 15e-1, 0]");  // the double is 9007199254740992
+    auto c = lazy_tree("[10e-1, 9.007199254740992e15, 0.15e1, 0.0e7]");
+    EXPECT_TRUE(*a == *b);
+    EXPECT_TRUE(*b == *c);
+    EXPECT_TRUE(*a == *c);
+    EXPECT_EQ(a->hash(), b->hash());
+    EXPECT_EQ(b->hash(), c->hash());
+
+    // every digit of a lazy number counts, even where the doubles are equal
+    EXPECT_TRUE(*lazy_tree("9007199254740993") != *lazy_tree("9007199254740992"));
+    EXPECT_TRUE(*lazy_tree("9007199254740993") != *parse_tree("9007199254740993"));
+    EXPECT_TRUE(*lazy_tree("0.1") != *parse_tree("0.1"));
+    EXPECT_TRUE(*lazy_tree("0.1000000000000000055511151231257827021181583404541015625") == *parse_tree("0.1"));
+    EXPECT_TRUE(*lazy_tree("1e-400") != *lazy_tree("0"));
+    EXPECT_TRUE(*lazy_tree("1e-400") == *lazy_tree("10e-401"));
+    EXPECT_TRUE(*lazy_tree("-2e-1074") != *parse_tree("-5e-324"));
+    EXPECT_TRUE(*lazy_tree("4.9406564584124654e-324") != *parse_tree("5e-324"));
+    EXPECT_TRUE(*lazy_tree("179769313486231570814527423731704356798070567525844996598917476803157260780028538760589558632766878171540458953514382464234321326889464182768467546703537516986049910576551282076245490090389328944075868508455133942304583236903222948165808559332123348274797826204144723168738177180919299881250404026184124858368") ==
+                *parse_tree("1.7976931348623157e308"));
+
+    // diff keeps changes that only lazy numbers can tell apart
+    auto from = lazy_tree("{\"id\": 12345678901234567890}");
+    auto to = lazy_tree("{\"id\": 12345678901234567891}");
+    auto patch = diff(from, to);
+    EXPECT_EQ(get<vector<shared_ptr<dson_value>>>(patch->option_value().value()).size(), 1u);
+    EXPECT_EQ(apply_patch(from, patch), error_type::DSON_OK);
+    EXPECT_TRUE(*from == *to);
+}
+
+TEST(dson, lazy_number_patch_text) {
+    auto root = parse_tree("{\"a\": 1}");
+    dson_generator gen;
+    {
+        auto json = make_unique<string>("[{\"op\": \"add\", \"path\": \"/b\", \"value\": [12345678901234567890, -0.10]}]");
+        dson_parser lazy;
+        lazy.set_lazy_number(true);
+        EXPECT_EQ(lazy.parse(*json), error_type::DSON_OK);
+        EXPECT_EQ(apply_patch(root, lazy.root()), error_type::DSON_OK);
+        json->assign(json->size(), 'x');
+    }
+    {
+        auto json = make_unique<string>("{\"c\": 1.50e2}");
+        dson_parser lazy;
+        lazy.set_lazy_number(true);
+        EXPECT_EQ(lazy.parse(*json), error_type::DSON_OK);
+        apply_merge_patch(root, lazy.root());
+    }
+    // the patches and their input are gone, the copied numbers still have their text
+    const auto& obj = get<unordered_map<string, shared_ptr<dson_value>>>(root->option_value().value());
+    EXPECT_EQ(gen.stringify_raw(obj.at("b")), "[12345678901234567890,-0.10]");
+    EXPECT_EQ(gen.stringify_raw(obj.at("c")), "1.50e2");
+}
+
+static shared_ptr<dson_value> string_value(const string& str) {
+    auto v = make_shared<dson_value>();
+    v->set_option_value(str);
+    v->set_type(dson_type::DSON_STRING);
+    return v;
+}
+
+TEST(dson, stringify_escape) {
+    dson_generator gen;
+    // escapes at every position around the 16 and 32 byte blocks
+    for (size_t pos = 0; pos < 70; ++pos) {
+        for (char ch : { '"', '\\', '\n', '\x1F', '\x7F' }) {
+            string str(70, 'a');
+            str[pos] = ch;
+            string expect(70, 'a');
+            string escaped = ch == '"' ? "\\\"" : ch == '\\' ? "\\\\" : ch == '\n' ? "\\n" : ch == '\x1F' ? "\\u001F" : "\x7F";
+            expect.replace(pos, 1, escaped);
+            EXPECT_EQ(gen.stringify_raw(string_value(str)), "\"" + expect + "\"");
+        }
+    }
+    EXPECT_EQ(gen.stringify_raw(string_value(string("\0\b\f\r\t/", 6))), "\"\\u0000\\b\\f\\r\\t/\"");
+    EXPECT_EQ(gen.stringify_raw(string_value("\xE6\x9D\xAD\xF0\x9D\x84\x9E")), "\"\xE6\x9D\xAD\xF0\x9D\x84\x9E\"");
+    EXPECT_EQ(gen.stringify_raw(parse_tree("[0.1, -2, 1e21, 123456789, 3.14159265]")), "[0.1,-2,1e+21,1.23457e+08,3.14159]");
+
+    gen.set_escape_unicode(true);
+    EXPECT_EQ(gen.stringify_raw(string_value("a\xC3\xA9\xE6\x9D\xAD\xF0\x9D\x84\x9E\"")), "\"a\\u00E9\\u676D\\uD834\\uDD1E\\\"\"");
+    // ill-formed bytes, a truncated sequence and an encoded surrogate
+    EXPECT_EQ(gen.stringify_raw(string_value("\xFF" "b\xE6\x9D" "c\xED\xA0\x80")), "\"\\uFFFDb\\uFFFD\\uFFFDc\\uFFFD\\uFFFD\\uFFFD\"");
+    string long_text;
+    for (int i = 0; i < 20; ++i) long_text += "abc\xC3\xA9";
+    string expect;
+    for (int i = 0; i < 20; ++i) expect += "abc\\u00E9";
+    EXPECT_EQ(gen.stringify_raw(string_value(long_text)), "\"" + expect + "\"");
+
+    // parallel chunks escape the same way
+    auto root = parse_tree("[\"\xC3\xA9\", \"x\", \"\xE6\x9D\xAD\"]");
+    gen.set_parallel(2, 1);
+    EXPECT_EQ(gen.stringify_raw(root), "[\"\\u00E9\",\"x\",\"\\u676D\"]");
+}
+
+TEST(dson, stringify_parallel) {
+    string json = "{\"small\": [1, 2], \"big\": [";
+    for (int i = 0; i < 300; ++i) json += (i ? ", " : "") + string("{\"id\": ") + to_string(i) + ", \"tags\": [\"x\", \"y\", " + to_string(i % 7) + "]}";
+    json += "], \"map\": {";
+    for (int i = 0; i < 100; ++i) json += (i ? ", \"k" : "\"k") + to_string(i) + "\": [" + to_string(i) + "]";
+    json += "}}";
+    auto root = parse_tree(json);
+
+    dson_generator sequential;
+    string expect = sequential.stringify_raw(root);
+    for (unsigned threads : { 0u, 2u, 3u, 8u }) {
+        for (size_t grain : { 1, 3, 50, 1000 }) {
+            dson_generator gen;
+            gen.set_parallel(threads, grain);
+            EXPECT_EQ(gen.stringify_raw(root), expect);
+            string joined;
+            gen.stringify_raw(root, [&joined](const vector<string_view>& buffers) {
+                for (const auto& buf : buffers) joined += buf;
+            });
+            EXPECT_EQ(joined, expect);
+        }
+    }
+
+    // the workers are kept across calls and shared by copies, which may run concurrently
+    dson_generator gen;
+    gen.set_parallel(4, 10);
+    EXPECT_EQ(gen.stringify_raw(root), expect);
+    dson_generator copy = gen;
+    vector<string> outputs(4);
+    vector<thread> callers;
+    for (size_t i = 0; i < outputs.size(); ++i)
+        callers.emplace_back([&, i] {
+            for (int k = 0; k < 20; ++k) outputs[i] = (i % 2 ? copy : gen).stringify_raw(root);
+        });
+    for (auto& t : callers) t.join();
+    for (const auto& out : outputs) EXPECT_EQ(out, expect);
+
+    // a freshly configured generator can be shared from its very first call
+    dson_generator fresh;
+    fresh.set_parallel(4, 8);
+    callers.clear();
+    for (size_t i = 0; i < outputs.size(); ++i) callers.emplace_back([&, i] { outputs[i] = fresh.stringify_raw(root); });
+    for (auto& t : callers) t.join();
+    for (const auto& out : outputs) EXPECT_EQ(out, expect);
+}
+
+TEST(dson, minify) {
+    auto [json, err] = minify(" { \"a b\" : [ 1.50 , 12345678901234567890, -0e+0 ] ,\n\t\"c\\\" d\" : { } } ");
+    EXPECT_EQ(err, error_type::DSON_OK);
+    EXPECT_EQ(json, "{\"a b\":[1.50,12345678901234567890,-0e+0],\"c\\\" d\":{}}");
+
+    EXPECT_EQ(minify("1 \n 2\n[3] {}").first, "1\n2\n[3]\n{}");
+    EXPECT_EQ(minify("").second, error_type::DSON_EXPECT_VALUE);
+    EXPECT_EQ(minify("\"abc").second, error_type::DSON_MISS_QUOTATION_MARK);
+    EXPECT_EQ(minify("[1, 2").second, error_type::DSON_MISS_COMMA_OR_SQUARE_BRACKET);
+    EXPECT_EQ(minify("[1 2]").second, error_type::DSON_MISS_COMMA_OR_SQUARE_BRACKET);
+    EXPECT_EQ(minify("{\"a\": 1]").second, error_type::DSON_MISS_COMMA_OR_CURLY_BRACKET);
+    EXPECT_EQ(minify("[1,]").second, error_type::DSON_INVALID_VALUE);
+    EXPECT_EQ(minify("[1] ]").second, error_type::DSON_ROOT_NOT_SINGULAR);
+    EXPECT_EQ(minify("{:1}").second, error_type::DSON_MISS_KEY);
+
+    // object members go key, colon, value; errors match the parser's
+    EXPECT_EQ(minify("{\"a\":1:2}").second, error_type::DSON_MISS_COMMA_OR_CURLY_BRACKET);
+    EXPECT_EQ(minify("{\"a\",\"b\"}").second, error_type::DSON_MISS_COLON);
+    EXPECT_EQ(minify("{\"a\"}").second, error_type::DSON_MISS_COLON);
+    EXPECT_EQ(minify("{1:2}").second, error_type::DSON_MISS_KEY);
+    EXPECT_EQ(minify("{\"a\":1,\"b\"}").second, error_type::DSON_MISS_COLON);
+    EXPECT_EQ(minify("{\"a\" \"b\"}").second, error_type::DSON_MISS_COLON);
+    for (const char* json : { "{\"a\":1,}", "{\"a\":}", "{\"a\"::1}", "{,}", "{]", "[}", "{\"a\":]", "{\"a\":[}]}", "{[]:1}", "{\"a\":1 \"b\":2}", "{", "{\"a\"",
+                              "{\"a\":", "{\"a\":1", "{\"a\":1,", "[", "[1,", "[:]", "{\"a\":{\"b\":1}:2}", "[{\"a\":1},{\"b\"}]" })
+        EXPECT_EQ(minify(json).second, validate(json).first) << json;
+
+    // literals, numbers and string contents are checked too, also when a chunk ends inside them
+    for (const char* json : { "[tru, 01, -, 1.2.3, \"\x01\"]", "tru", "nul", "truex", "[nullx]", "{\"a\":falsey}", "01", "[-]", "[1.2.3]", "[1.]", "[.5]", "[1e]", "[+1]",
+                              "[1e400]", "-1e309", "[\"\x01\"]", "\"a\tb\"", "{\"\n\":1}", "\"\\x\"", "\"\\u12G4\"", "\"\\uD800\"", "\"\\uD800\\n\"", "\"\\uD800\\uD800\"",
+                              "\"\\uD83D\\uDE00\"", "\"\\uDE00\"", "\"\\", "\"\\u12", "\"\\uD800\\", "[0, -0.5e+3, 1E-2, true, false, null]" }) {
+        EXPECT_EQ(minify(json).second, validate(json).first) << json;
+        string_view view(json);
+        for (size_t i = 0; i <= view.size(); ++i) {
+            dson_transcoder t;
+            string out;
+            t.feed(view.substr(0, i), out);
+            t.feed(view.substr(i), out);
+            EXPECT_EQ(t.finish(), validate(json).first) << json << " split at " << i;
+        }
+    }
+}
+
+TEST(dson, minify_inplace) {
+    string json = "[ \"  keep  \" ,\r\n  { \"k\" : null } ,  tru e ]";
+    auto [size, err] = dson_transcoder::minify_inplace(&json[0], json.size());
+    EXPECT_EQ(err, error_type::DSON_INVALID_VALUE);
+    json = "[ \"  keep  \" ,\r\n  { \"k\" : null } ,  true ]\n\n[ ]";
+    tie(size, err) = dson_transcoder::minify_inplace(&json[0], json.size());
+    EXPECT_EQ(err, error_type::DSON_OK);
+    EXPECT_EQ(json.substr(0, size), "[\"  keep  \",{\"k\":null},true]\n[]");
+}
+
+TEST(dson, prettify) {
+    auto [json, err] = prettify("{\"a\":[1,2.0e5,[]],\"b\":{},\"c\":{\"d\":\"x\"}}", 2);
+    EXPECT_EQ(err, error_type::DSON_OK);
+    EXPECT_EQ(json, "{\n  \"a\": [\n    1,\n    2.0e5,\n    []\n  ],\n  \"b\": {},\n  \"c\": {\n    \"d\": \"x\"\n  }\n}");
+    EXPECT_EQ(prettify("[1]", 0).first, "[\n1\n]");
+}
+
+TEST(dson, transcoder_chunked) {
+    string json = " {\"name\": \"a \\\"quoted\\\" \\\\ value\", \"list\": [ 1.25e-3, true , false,null, \"\\u20AC\" ], \"n\": -12345678901234567890.5 }\n[0]";
+    for (int indent : { -1, 4 }) {
+        dson_transcoder whole(indent);
+        string expect;
+        EXPECT_EQ(whole.feed(json, expect), error_type::DSON_OK);
+        EXPECT_EQ(whole.finish(), error_type::DSON_OK);
+        // every split point, including inside strings, escapes and numbers
+        for (size_t i = 0; i <= json.size(); ++i) {
+            dson_transcoder t(indent);
+            string out;
+            t.feed(string_view(json).substr(0, i), out);
+            t.feed(string_view(json).substr(i), out);
+            EXPECT_EQ(t.finish(), error_type::DSON_OK);
+            EXPECT_EQ(out, expect);
+        }
+    }
+}
+
 int main(int argc, char* argv[]) {
 #ifdef _WINDOWS
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
@@ -4,14 +4,17 @@ target("dson")
     set_kind("binary")
     set_languages("c++17")
     add_includedirs("include")
-    add_files("src/dson.cpp")
+    add_files("src/*.cpp")
     add_cxxflags("/EHsc")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
 
 target("test")
     set_kind("binary")
     set_languages("c++17")
     add_includedirs("include")
-    add_files("src/dson.cpp", "test/test.cpp")
+    add_files("src/*.cpp", "test/test.cpp")
     on_load(function(target)
         target:add(find_packages("vcpkg::gtest"))
     end)
@@ -21,6 +24,24 @@ target("test")
         add_cxxflags("/MD")
     end
     add_cxxflags("/EHsc")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
+
+target("bench")
+    set_kind("binary")
+    set_languages("c++17")
+    add_includedirs("include")
+    add_files("src/*.cpp", "bench/bench.cpp")
+    if is_mode("debug") then
+        add_cxxflags("/MDd")
+    else 
+        add_cxxflags("/MD")
+    end
+    add_cxxflags("/EHsc")
+    if is_plat("linux") then
+        add_syslinks("pthread")
+    end
 
 --
 -- If you want to known more usage about xmake, please see https://xmake.io